@@ -0,0 +1,60 @@
+#include "cb.h"
+
+static void group_lmul(const int N, const struct cb *const restrict cb,
+		const int g, num *const restrict A)
+{
+	const int n_bond = cb->n_bond;
+	for (int k = 0; k < N; k++) {
+		num *const restrict a = A + N*k;
+		for (int b = cb->group[g]; b < cb->group[g + 1]; b++) {
+			const int i = cb->bonds[b], j = cb->bonds[b + n_bond];
+			const num *const restrict m = cb->m + 4*b;
+			const num x = a[i], y = a[j];
+			a[i] = m[0]*x + m[1]*y;
+			a[j] = m[2]*x + m[3]*y;
+		}
+	}
+}
+
+static void group_rmul(const int N, const struct cb *const restrict cb,
+		const int g, num *const restrict A)
+{
+	const int n_bond = cb->n_bond;
+	for (int b = cb->group[g]; b < cb->group[g + 1]; b++) {
+		const int i = cb->bonds[b], j = cb->bonds[b + n_bond];
+		const num *const restrict m = cb->m + 4*b;
+		num *const restrict ai = A + N*i;
+		num *const restrict aj = A + N*j;
+		for (int k = 0; k < N; k++) {
+			const num x = ai[k], y = aj[k];
+			ai[k] = x*m[0] + y*m[2];
+			aj[k] = x*m[1] + y*m[3];
+		}
+	}
+}
+
+// the sequence of factors is a palindrome, so both sides apply them in
+// the same order
+void cb_lmul(const int N, const struct cb *const restrict cb,
+		num *const restrict A)
+{
+	for (int g = cb->n_group - 1; g >= 0; g--)
+		group_lmul(N, cb, g, A);
+	for (int k = 0; k < N; k++)
+		for (int i = 0; i < N; i++)
+			A[i + N*k] *= cb->d[i];
+	for (int g = 0; g < cb->n_group; g++)
+		group_lmul(N, cb, g, A);
+}
+
+void cb_rmul(const int N, const struct cb *const restrict cb,
+		num *const restrict A)
+{
+	for (int g = cb->n_group - 1; g >= 0; g--)
+		group_rmul(N, cb, g, A);
+	for (int k = 0; k < N; k++)
+		for (int i = 0; i < N; i++)
+			A[i + N*k] *= cb->d[k];
+	for (int g = 0; g < cb->n_group; g++)
+		group_rmul(N, cb, g, A);
+}
@@ -0,0 +1,22 @@
+#pragma once
+
+#include "util.h"
+
+// checkerboard decomposition of exp(-dt K) (or of its inverse):
+// exp_K = E_{G-1} ... E_0 D E_0 ... E_{G-1}, where D is the diagonal part
+// and each E_g is a product of commuting 2x2 bond propagators
+struct cb {
+	int n_group, n_bond;
+	const int *group; // bonds of group g are group[g] to group[g+1] - 1
+	const int *bonds; // 2 x n_bond, like params.bonds
+	const num *m;     // n_bond x 2 x 2, row-major exp(-dt/2 K_b) for each bond
+	const double *d;  // N, diagonal part
+};
+
+// A = exp_K A, for N x N matrix A. O(N^2 G) instead of O(N^3)
+void cb_lmul(const int N, const struct cb *const restrict cb,
+		num *const restrict A);
+
+// A = A exp_K, for N x N matrix A
+void cb_rmul(const int N, const struct cb *const restrict cb,
+		num *const restrict A);
@@ -2,6 +2,7 @@
 #include <stdio.h>
 #include <hdf5.h>
 #include <hdf5_hl.h>
+#include "fftm.h"
 #include "util.h"
 
 #define return_if(cond, val, ...) \
@@ -9,6 +10,358 @@
 
 static hid_t num_h5t;
 
+// measurement arrays, for the file's walker and for the others in
+// multi-walker runs
+static void meas_alloc(const struct params *p, struct meas_eqlt *m_eq,
+		struct meas_uneqlt *m_ue)
+{
+	const int L = p->L;
+	const int num_i = p->num_i, num_ij = p->num_ij;
+	const int num_bs = p->num_bs, num_bb = p->num_bb, num_bbb = p->num_bbb, num_bbb_lim = p->num_bbb_lim;
+
+	m_eq->density    = my_calloc(num_i    * sizeof(num));
+	m_eq->double_occ = my_calloc(num_i    * sizeof(num));
+	m_eq->g00        = my_calloc(num_ij   * sizeof(num));
+	m_eq->nn         = my_calloc(num_ij   * sizeof(num));
+	m_eq->xx         = my_calloc(num_ij   * sizeof(num));
+	m_eq->zz         = my_calloc(num_ij   * sizeof(num));
+	m_eq->pair_sw    = my_calloc(num_ij   * sizeof(num));
+	if (p->meas_energy_corr) {
+		m_eq->kk = my_calloc(num_bb * sizeof(num));
+		m_eq->kv = my_calloc(num_bs * sizeof(num));
+		m_eq->kn = my_calloc(num_bs * sizeof(num));
+		m_eq->vv = my_calloc(num_ij * sizeof(num));
+		m_eq->vn = my_calloc(num_ij * sizeof(num));
+	}
+	if (p->period_uneqlt > 0) {
+		m_ue->gt0     = my_calloc(num_ij*L * sizeof(num));
+		m_ue->nn      = my_calloc(num_ij*L * sizeof(num));
+		m_ue->xx      = my_calloc(num_ij*L * sizeof(num));
+		m_ue->zz      = my_calloc(num_ij*L * sizeof(num));
+		m_ue->pair_sw = my_calloc(num_ij*L * sizeof(num));
+		if (p->meas_bond_corr) {
+			m_ue->pair_bb = my_calloc(num_bb*L * sizeof(num));
+			m_ue->jj      = my_calloc(num_bb*L * sizeof(num));
+			m_ue->jsjs    = my_calloc(num_bb*L * sizeof(num));
+			m_ue->kk      = my_calloc(num_bb*L * sizeof(num));
+			m_ue->ksks    = my_calloc(num_bb*L * sizeof(num));
+		}
+                if (p->meas_3curr) {
+ 			m_ue->jjj = my_calloc(num_bbb*L * sizeof(num));
+ 		}
+		if (p->meas_3curr && p->jjj_n_sample > 0)
+			m_ue->jjj_n = my_calloc(num_bbb * sizeof(int));
+                if (p->meas_3curr_limit) {
+                        m_ue->jjj_l = my_calloc(num_bbb_lim * L * sizeof(num));
+                }
+		if (p->meas_energy_corr) {
+			m_ue->kv      = my_calloc(num_bs*L * sizeof(num));
+			m_ue->kn      = my_calloc(num_bs*L * sizeof(num));
+			m_ue->vv      = my_calloc(num_ij*L * sizeof(num));
+			m_ue->vn      = my_calloc(num_ij*L * sizeof(num));
+		}
+		if (p->meas_nematic_corr) {
+			m_ue->nem_nnnn = my_calloc(num_bb*L * sizeof(num));
+			m_ue->nem_ssss = my_calloc(num_bb*L * sizeof(num));
+		}
+	}
+}
+
+static void meas_free(const struct params *p, const struct meas_eqlt *m_eq,
+		const struct meas_uneqlt *m_ue)
+{
+	if (p->period_uneqlt > 0) {
+		if (p->meas_nematic_corr) {
+			my_free(m_ue->nem_ssss);
+			my_free(m_ue->nem_nnnn);
+		}
+		if (p->meas_energy_corr) {
+			my_free(m_ue->vn);
+			my_free(m_ue->vv);
+			my_free(m_ue->kn);
+			my_free(m_ue->kv);
+		}
+		if (p->meas_3curr && p->jjj_n_sample > 0)
+			my_free(m_ue->jjj_n);
+		if (p->meas_3curr)
+			my_free(m_ue->jjj);
+		if (p->meas_3curr_limit)
+			my_free(m_ue->jjj_l);
+		if (p->meas_bond_corr) {
+			my_free(m_ue->ksks);
+			my_free(m_ue->kk);
+			my_free(m_ue->jsjs);
+			my_free(m_ue->jj);
+			my_free(m_ue->pair_bb);
+		}
+		my_free(m_ue->pair_sw);
+		my_free(m_ue->zz);
+		my_free(m_ue->xx);
+		my_free(m_ue->nn);
+		my_free(m_ue->gt0);
+	}
+	if (p->meas_energy_corr) {
+		my_free(m_eq->vn);
+		my_free(m_eq->vv);
+		my_free(m_eq->kn);
+		my_free(m_eq->kv);
+		my_free(m_eq->kk);
+	}
+	my_free(m_eq->pair_sw);
+	my_free(m_eq->zz);
+	my_free(m_eq->xx);
+	my_free(m_eq->nn);
+	my_free(m_eq->g00);
+	my_free(m_eq->double_occ);
+	my_free(m_eq->density);
+}
+
+// adds the measurements of a walker into dst, and zeroes them so that
+// the next reduction only adds what was measured since
+static void meas_add(const struct params *p,
+		struct meas_eqlt *dst_eq, struct meas_uneqlt *dst_ue,
+		struct meas_eqlt *src_eq, struct meas_uneqlt *src_ue)
+{
+	const int L = p->L;
+	const int num_i = p->num_i, num_ij = p->num_ij;
+	const int num_bs = p->num_bs, num_bb = p->num_bb, num_bbb = p->num_bbb, num_bbb_lim = p->num_bbb_lim;
+
+#define add(m, name, n) do { \
+	for (int i = 0; i < (n); i++) { \
+		dst_##m->name[i] += src_##m->name[i]; \
+		src_##m->name[i] = 0.0; \
+	} \
+} while (0);
+
+	dst_eq->n_sample += src_eq->n_sample;
+	dst_eq->sign += src_eq->sign;
+	src_eq->n_sample = 0;
+	src_eq->sign = 0.0;
+	add(eq, density,    num_i);
+	add(eq, double_occ, num_i);
+	add(eq, g00,        num_ij);
+	add(eq, nn,         num_ij);
+	add(eq, xx,         num_ij);
+	add(eq, zz,         num_ij);
+	add(eq, pair_sw,    num_ij);
+	if (p->meas_energy_corr) {
+		add(eq, kk, num_bb);
+		add(eq, kv, num_bs);
+		add(eq, kn, num_bs);
+		add(eq, vv, num_ij);
+		add(eq, vn, num_ij);
+	}
+	if (p->period_uneqlt > 0) {
+		dst_ue->n_sample += src_ue->n_sample;
+		dst_ue->sign += src_ue->sign;
+		src_ue->n_sample = 0;
+		src_ue->sign = 0.0;
+		add(ue, gt0,     num_ij*L);
+		add(ue, nn,      num_ij*L);
+		add(ue, xx,      num_ij*L);
+		add(ue, zz,      num_ij*L);
+		add(ue, pair_sw, num_ij*L);
+		if (p->meas_bond_corr) {
+			add(ue, pair_bb, num_bb*L);
+			add(ue, jj,      num_bb*L);
+			add(ue, jsjs,    num_bb*L);
+			add(ue, kk,      num_bb*L);
+			add(ue, ksks,    num_bb*L);
+		}
+		if (p->meas_3curr)
+			add(ue, jjj, num_bbb*L);
+		if (p->meas_3curr && p->jjj_n_sample > 0)
+			add(ue, jjj_n, num_bbb);
+		if (p->meas_3curr_limit)
+			add(ue, jjj_l, num_bbb_lim*L);
+		if (p->meas_energy_corr) {
+			add(ue, kv, num_bs*L);
+			add(ue, kn, num_bs*L);
+			add(ue, vv, num_ij*L);
+			add(ue, vn, num_ij*L);
+		}
+		if (p->meas_nematic_corr) {
+			add(ue, nem_nnnn, num_bb*L);
+			add(ue, nem_ssss, num_bb*L);
+		}
+	}
+
+#undef add
+}
+
+// measurements under prefix, "" for the top level groups
+static int meas_read(const hid_t file_id, const char *prefix,
+		const struct params *p, struct meas_eqlt *m_eq,
+		struct meas_uneqlt *m_ue)
+{
+	char path[128];
+	herr_t status;
+
+#define my_read(_type, name, ...) do { \
+	snprintf(path, sizeof(path), "%s%s", prefix, (name)); \
+	status = H5LTread_dataset##_type(file_id, path, __VA_ARGS__); \
+	return_if(status < 0, -1, "H5LTread_dataset() failed for %s: %d\n", path, status); \
+} while (0);
+
+	my_read(_int,    "/meas_eqlt/n_sample",   &m_eq->n_sample);
+	my_read( , "/meas_eqlt/sign",        num_h5t, &m_eq->sign);
+	my_read( , "/meas_eqlt/density",     num_h5t, m_eq->density);
+	my_read( , "/meas_eqlt/double_occ",  num_h5t, m_eq->double_occ);
+	my_read( , "/meas_eqlt/g00",         num_h5t, m_eq->g00);
+	my_read( , "/meas_eqlt/nn",          num_h5t, m_eq->nn);
+	my_read( , "/meas_eqlt/xx",          num_h5t, m_eq->xx);
+	my_read( , "/meas_eqlt/zz",          num_h5t, m_eq->zz);
+	my_read( , "/meas_eqlt/pair_sw",     num_h5t, m_eq->pair_sw);
+	if (p->meas_energy_corr) {
+		my_read( , "/meas_eqlt/kk", num_h5t, m_eq->kk);
+		my_read( , "/meas_eqlt/kv", num_h5t, m_eq->kv);
+		my_read( , "/meas_eqlt/kn", num_h5t, m_eq->kn);
+		my_read( , "/meas_eqlt/vv", num_h5t, m_eq->vv);
+		my_read( , "/meas_eqlt/vn", num_h5t, m_eq->vn);
+	}
+	if (p->period_uneqlt > 0) {
+		my_read(_int,    "/meas_uneqlt/n_sample", &m_ue->n_sample);
+		my_read( , "/meas_uneqlt/sign",      num_h5t, &m_ue->sign);
+		my_read( , "/meas_uneqlt/gt0",       num_h5t, m_ue->gt0);
+		my_read( , "/meas_uneqlt/nn",        num_h5t, m_ue->nn);
+		my_read( , "/meas_uneqlt/xx",        num_h5t, m_ue->xx);
+		my_read( , "/meas_uneqlt/zz",        num_h5t, m_ue->zz);
+		my_read( , "/meas_uneqlt/pair_sw",   num_h5t, m_ue->pair_sw);
+		if (p->meas_bond_corr) {
+			my_read( , "/meas_uneqlt/pair_bb", num_h5t, m_ue->pair_bb);
+			my_read( , "/meas_uneqlt/jj",      num_h5t, m_ue->jj);
+			my_read( , "/meas_uneqlt/jsjs",    num_h5t, m_ue->jsjs)
+			my_read( , "/meas_uneqlt/kk",      num_h5t, m_ue->kk);
+			my_read( , "/meas_uneqlt/ksks",    num_h5t, m_ue->ksks);
+		}
+                if (p->meas_3curr) {
+ 			my_read(_double, "/meas_uneqlt/jjj", m_ue->jjj);
+ 		}
+		if (p->meas_3curr && p->jjj_n_sample > 0)
+			my_read(_int, "/meas_uneqlt/jjj_n", m_ue->jjj_n);
+                if (p->meas_3curr_limit) {
+                        my_read(_double, "/meas_uneqlt/jjj_l", m_ue->jjj_l);
+                }
+		if (p->meas_energy_corr) {
+			my_read( , "/meas_uneqlt/kv", num_h5t, m_ue->kv);
+			my_read( , "/meas_uneqlt/kn", num_h5t, m_ue->kn);
+			my_read( , "/meas_uneqlt/vv", num_h5t, m_ue->vv);
+			my_read( , "/meas_uneqlt/vn", num_h5t, m_ue->vn);
+		}
+		if (p->meas_nematic_corr) {
+			my_read( , "/meas_uneqlt/nem_nnnn", num_h5t, m_ue->nem_nnnn);
+			my_read( , "/meas_uneqlt/nem_ssss", num_h5t, m_ue->nem_ssss);
+		}
+	}
+
+#undef my_read
+
+	return 0;
+}
+
+static int meas_write(const hid_t file_id, const char *prefix,
+		const struct params *p, const struct meas_eqlt *m_eq,
+		const struct meas_uneqlt *m_ue)
+{
+	char path[128];
+	herr_t status;
+	hid_t dset_id;
+
+#define my_write(name, type, data) do { \
+	snprintf(path, sizeof(path), "%s%s", prefix, (name)); \
+	dset_id = H5Dopen2(file_id, path, H5P_DEFAULT); \
+	return_if(dset_id < 0, -1, "H5Dopen2() failed for %s: %ld\n", path, dset_id); \
+	status = H5Dwrite(dset_id, (type), H5S_ALL, H5S_ALL, H5P_DEFAULT, (data)); \
+	return_if(status < 0, -1, "H5Dwrite() failed for %s: %d\n", path, status); \
+	status = H5Dclose(dset_id); \
+	return_if(status < 0, -1, "H5Dclose() failed for %s: %d\n", path, status); \
+} while (0);
+
+	my_write("/meas_eqlt/n_sample",   H5T_NATIVE_INT,    &m_eq->n_sample);
+	my_write("/meas_eqlt/sign",       num_h5t, &m_eq->sign);
+	my_write("/meas_eqlt/density",    num_h5t,  m_eq->density);
+	my_write("/meas_eqlt/double_occ", num_h5t,  m_eq->double_occ);
+	my_write("/meas_eqlt/g00",        num_h5t,  m_eq->g00);
+	my_write("/meas_eqlt/nn",         num_h5t,  m_eq->nn);
+	my_write("/meas_eqlt/xx",         num_h5t,  m_eq->xx);
+	my_write("/meas_eqlt/zz",         num_h5t,  m_eq->zz);
+	my_write("/meas_eqlt/pair_sw",    num_h5t,  m_eq->pair_sw);
+	if (p->meas_energy_corr) {
+		my_write("/meas_eqlt/kk", num_h5t, m_eq->kk);
+		my_write("/meas_eqlt/kv", num_h5t, m_eq->kv);
+		my_write("/meas_eqlt/kn", num_h5t, m_eq->kn);
+		my_write("/meas_eqlt/vv", num_h5t, m_eq->vv);
+		my_write("/meas_eqlt/vn", num_h5t, m_eq->vn);
+	}
+	if (p->period_uneqlt > 0) {
+		my_write("/meas_uneqlt/n_sample", H5T_NATIVE_INT,    &m_ue->n_sample);
+		my_write("/meas_uneqlt/sign",     num_h5t, &m_ue->sign);
+		my_write("/meas_uneqlt/gt0",      num_h5t,  m_ue->gt0);
+		my_write("/meas_uneqlt/nn",       num_h5t,  m_ue->nn);
+		my_write("/meas_uneqlt/xx",       num_h5t,  m_ue->xx);
+		my_write("/meas_uneqlt/zz",       num_h5t,  m_ue->zz);
+		my_write("/meas_uneqlt/pair_sw",  num_h5t,  m_ue->pair_sw);
+		if (p->meas_bond_corr) {
+			my_write("/meas_uneqlt/pair_bb", num_h5t, m_ue->pair_bb);
+			my_write("/meas_uneqlt/jj",      num_h5t, m_ue->jj);
+			my_write("/meas_uneqlt/jsjs",    num_h5t, m_ue->jsjs);
+			my_write("/meas_uneqlt/kk",      num_h5t, m_ue->kk);
+			my_write("/meas_uneqlt/ksks",    num_h5t, m_ue->ksks);
+		}
+                if (p->meas_3curr) {
+ 			my_write("/meas_uneqlt/jjj", H5T_NATIVE_DOUBLE, m_ue->jjj);
+ 		}
+		if (p->meas_3curr && p->jjj_n_sample > 0)
+			my_write("/meas_uneqlt/jjj_n", H5T_NATIVE_INT, m_ue->jjj_n);
+                if (p->meas_3curr_limit) {
+                        my_write("/meas_uneqlt/jjj_l", H5T_NATIVE_DOUBLE, m_ue->jjj_l);
+                }
+		if (p->meas_energy_corr) {
+			my_write("/meas_uneqlt/kv", num_h5t, m_ue->kv);
+			my_write("/meas_uneqlt/kn", num_h5t, m_ue->kn);
+			my_write("/meas_uneqlt/vv", num_h5t, m_ue->vv);
+			my_write("/meas_uneqlt/vn", num_h5t, m_ue->vn);
+		}
+		if (p->meas_nematic_corr) {
+			my_write("/meas_uneqlt/nem_nnnn", num_h5t, m_ue->nem_nnnn);
+			my_write("/meas_uneqlt/nem_ssss", num_h5t, m_ue->nem_ssss);
+		}
+	}
+
+	// structure factors of the 2 site measurements, transformed from the
+	// sums so far at every save. not read back, as they follow from these
+	if (p->meas_fft) {
+		const int L = p->L, num_ij = p->num_ij;
+		num *const restrict sq = my_calloc(num_ij*L * sizeof(num));
+
+#define my_write_sq(name, data, n) do { \
+	status = fftm_sq(p->Nx, p->Ny, (n), (data), sq); \
+	return_if(status < 0, -1, "fftm_sq() failed for %s\n", (name)); \
+	my_write((name), num_h5t, sq); \
+} while (0);
+
+		my_write_sq("/meas_eqlt/g00_q",       m_eq->g00,     1);
+		my_write_sq("/meas_eqlt/nn_q",        m_eq->nn,      1);
+		my_write_sq("/meas_eqlt/xx_q",        m_eq->xx,      1);
+		my_write_sq("/meas_eqlt/zz_q",        m_eq->zz,      1);
+		my_write_sq("/meas_eqlt/pair_sw_q",   m_eq->pair_sw, 1);
+		if (p->period_uneqlt > 0) {
+			my_write_sq("/meas_uneqlt/gt0_q",     m_ue->gt0,     L);
+			my_write_sq("/meas_uneqlt/nn_q",      m_ue->nn,      L);
+			my_write_sq("/meas_uneqlt/xx_q",      m_ue->xx,      L);
+			my_write_sq("/meas_uneqlt/zz_q",      m_ue->zz,      L);
+			my_write_sq("/meas_uneqlt/pair_sw_q", m_ue->pair_sw, L);
+		}
+
+#undef my_write_sq
+		my_free(sq);
+	}
+
+#undef my_write
+
+	return 0;
+}
+
 int sim_data_read_alloc(struct sim_data *sim, const char *file)
 {
 	const hid_t file_id = H5Fopen(file, H5F_ACC_RDONLY, H5P_DEFAULT);
@@ -34,6 +387,14 @@ int sim_data_read_alloc(struct sim_data *sim, const char *file)
 	return_if(status < 0, -1, "H5LTread_dataset() failed for %s: %d\n", (name), status); \
 } while (0);
 
+// for parameters added after older simulation files were generated
+#define my_read_opt(_type, name, def, ptr) do { \
+	if (H5Lexists(file_id, (name), H5P_DEFAULT) > 0) { \
+		my_read(_type, (name), (ptr)); \
+	} else \
+		*(ptr) = (def); \
+} while (0);
+
 	my_read(_int, "/params/N",      &sim->p.N);
 	my_read(_int, "/params/L",      &sim->p.L);
 	my_read(_int, "/params/num_i",  &sim->p.num_i);
@@ -50,8 +411,25 @@ int sim_data_read_alloc(struct sim_data *sim, const char *file)
 	my_read(_int, "/params/meas_nematic_corr", &sim->p.meas_nematic_corr);
 	my_read(_int, "/params/meas_3curr", &sim->p.meas_3curr);
         my_read(_int, "/params/meas_3curr_limit", &sim->p.meas_3curr_limit);
+	my_read_opt(_int, "/params/jjj_n_sample", 0, &sim->p.jjj_n_sample);
+	my_read_opt(_int, "/params/checkerboard", 0, &sim->p.checkerboard);
+	if (sim->p.checkerboard) {
+		my_read(_int, "/params/cb_n_group", &sim->p.cb_n_group);
+		my_read(_int, "/params/cb_n_bond", &sim->p.cb_n_bond);
+	}
+	my_read_opt(_int, "/params/fft_K", 0, &sim->p.fft_K);
+	my_read_opt(_int, "/params/meas_fft", 0, &sim->p.meas_fft);
+	if (sim->p.fft_K || sim->p.meas_fft) {
+		my_read(_int, "/params/Nx", &sim->p.Nx);
+		my_read(_int, "/params/Ny", &sim->p.Ny);
+	}
+	return_if(sim->p.meas_fft && sim->p.num_ij != sim->p.Nx*sim->p.Ny, -1,
+	          "meas_fft needs num_ij = Nx*Ny: %d\n", sim->p.num_ij);
+	my_read_opt(_int, "/params/n_int", sim->p.N, &sim->p.n_int);
+	my_read_opt(_int, "/params/ph_sym", 0, &sim->p.ph_sym);
 
 	const int N = sim->p.N, L = sim->p.L;
+	const int n_int = sim->p.n_int;
 	const int num_i = sim->p.num_i, num_ij = sim->p.num_ij;
 	const int num_b = sim->p.num_b, num_bs = sim->p.num_bs, num_bb = sim->p.num_bb, num_bbb = sim->p.num_bbb, num_bbb_lim = sim->p.num_bbb_lim;
 
@@ -83,50 +461,19 @@ int sim_data_read_alloc(struct sim_data *sim, const char *file)
 	sim->p.inv_exp_halfKd= my_calloc(N*N      * sizeof(num));
 	sim->p.exp_lambda    = my_calloc(N*2      * sizeof(double));
 	sim->p.del           = my_calloc(N*2      * sizeof(double));
-	sim->s.hs            = my_calloc(N*L      * sizeof(int));
-	sim->m_eq.density    = my_calloc(num_i    * sizeof(num));
-	sim->m_eq.double_occ = my_calloc(num_i    * sizeof(num));
-	sim->m_eq.g00        = my_calloc(num_ij   * sizeof(num));
-	sim->m_eq.nn         = my_calloc(num_ij   * sizeof(num));
-	sim->m_eq.xx         = my_calloc(num_ij   * sizeof(num));
-	sim->m_eq.zz         = my_calloc(num_ij   * sizeof(num));
-	sim->m_eq.pair_sw    = my_calloc(num_ij   * sizeof(num));
-	if (sim->p.meas_energy_corr) {
-		sim->m_eq.kk = my_calloc(num_bb * sizeof(num));
-		sim->m_eq.kv = my_calloc(num_bs * sizeof(num));
-		sim->m_eq.kn = my_calloc(num_bs * sizeof(num));
-		sim->m_eq.vv = my_calloc(num_ij * sizeof(num));
-		sim->m_eq.vn = my_calloc(num_ij * sizeof(num));
-	}
-	if (sim->p.period_uneqlt > 0) {
-		sim->m_ue.gt0     = my_calloc(num_ij*L * sizeof(num));
-		sim->m_ue.nn      = my_calloc(num_ij*L * sizeof(num));
-		sim->m_ue.xx      = my_calloc(num_ij*L * sizeof(num));
-		sim->m_ue.zz      = my_calloc(num_ij*L * sizeof(num));
-		sim->m_ue.pair_sw = my_calloc(num_ij*L * sizeof(num));
-		if (sim->p.meas_bond_corr) {
-			sim->m_ue.pair_bb = my_calloc(num_bb*L * sizeof(num));
-			sim->m_ue.jj      = my_calloc(num_bb*L * sizeof(num));
-			sim->m_ue.jsjs    = my_calloc(num_bb*L * sizeof(num));
-			sim->m_ue.kk      = my_calloc(num_bb*L * sizeof(num));
-			sim->m_ue.ksks    = my_calloc(num_bb*L * sizeof(num));
-		}
-                if (sim->p.meas_3curr) {
- 			sim->m_ue.jjj = my_calloc(num_bbb*L * sizeof(num));
- 		}
-                if (sim->p.meas_3curr_limit) {
-                        sim->m_ue.jjj_l = my_calloc(num_bbb_lim * L * sizeof(num));
-                }
-		if (sim->p.meas_energy_corr) {
-			sim->m_ue.kv      = my_calloc(num_bs*L * sizeof(num));
-			sim->m_ue.kn      = my_calloc(num_bs*L * sizeof(num));
-			sim->m_ue.vv      = my_calloc(num_ij*L * sizeof(num));
-			sim->m_ue.vn      = my_calloc(num_ij*L * sizeof(num));
-		}
-		if (sim->p.meas_nematic_corr) {
-			sim->m_ue.nem_nnnn = my_calloc(num_bb*L * sizeof(num));
-			sim->m_ue.nem_ssss = my_calloc(num_bb*L * sizeof(num));
-		}
+	sim->p.int_sites     = my_calloc(N        * sizeof(int));
+	sim->p.int_idx       = my_calloc(N        * sizeof(int));
+	sim->p.ph_sign       = sim->p.ph_sym ? my_calloc(N * sizeof(double)) : NULL;
+	sim->s.hs            = my_calloc(n_int*L  * sizeof(int));
+	meas_alloc(&sim->p, &sim->m_eq, &sim->m_ue);
+	if (sim->p.checkerboard) {
+		const int cb_n_group = sim->p.cb_n_group, cb_n_bond = sim->p.cb_n_bond;
+		sim->p.cb_group = my_calloc((cb_n_group + 1) * sizeof(int));
+		sim->p.cb_bonds = my_calloc(cb_n_bond*2      * sizeof(int));
+		sim->p.cb_mu    = my_calloc(2*cb_n_bond*4    * sizeof(num));
+		sim->p.cb_md    = my_calloc(2*cb_n_bond*4    * sizeof(num));
+		sim->p.cb_du    = my_calloc(2*N              * sizeof(double));
+		sim->p.cb_dd    = my_calloc(2*N              * sizeof(double));
 	}
 	// make sure anything appended here is free'd in sim_data_free()
 
@@ -145,6 +492,16 @@ int sim_data_read_alloc(struct sim_data *sim, const char *file)
 //	my_read(_double, "/params/dt",            &sim->p.dt);
 	my_read(_int,    "/params/n_matmul",      &sim->p.n_matmul);
 	my_read(_int,    "/params/n_delay",       &sim->p.n_delay);
+	my_read_opt(_int, "/params/n_delay_inner", 0, &sim->p.n_delay_inner);
+	my_read_opt(_int, "/params/update_method", 0, &sim->p.update_method);
+	my_read_opt(_int, "/params/udt_stack", 0, &sim->p.udt_stack);
+	my_read_opt(_int, "/params/stab",      0, &sim->p.stab);
+	my_read_opt(_double, "/params/wrap_tol", 0.0, &sim->p.wrap_tol);
+	my_read_opt(_int, "/params/global_period", 0, &sim->p.global_period);
+	my_read_opt(_int, "/params/global_cluster", 0, &sim->p.global_cluster);
+	int n_walker;
+	my_read_opt(_int, "/params/n_walker", 1, &n_walker);
+	my_read_opt(_int, "/params/replica_period", 0, &sim->p.replica_period);
 	my_read(_int,    "/params/n_sweep_warm",  &sim->p.n_sweep_warm);
 	my_read(_int,    "/params/n_sweep_meas",  &sim->p.n_sweep_meas);
 	my_read(_int,    "/params/period_eqlt",   &sim->p.period_eqlt);
@@ -165,59 +522,96 @@ int sim_data_read_alloc(struct sim_data *sim, const char *file)
 	my_read(_double, "/params/exp_lambda",     sim->p.exp_lambda);
 	my_read(_double, "/params/del",            sim->p.del);
 	my_read(_int,    "/params/F",             &sim->p.F);
+	if (sim->p.checkerboard) {
+		my_read(_int,    "/params/cb_group",       sim->p.cb_group);
+		my_read(_int,    "/params/cb_bonds",       sim->p.cb_bonds);
+		my_read( , "/params/cb_mu",      num_h5t,   sim->p.cb_mu);
+		my_read( , "/params/cb_md",      num_h5t,   sim->p.cb_md);
+		my_read(_double, "/params/cb_du",          sim->p.cb_du);
+		my_read(_double, "/params/cb_dd",          sim->p.cb_dd);
+	}
+	// interacting sites first, then the others, each in ascending order.
+	// files without /params/int_sites have every site interacting
+	if (H5Lexists(file_id, "/params/int_sites", H5P_DEFAULT) > 0) {
+		my_read(_int,    "/params/int_sites",      sim->p.int_sites);
+	} else
+		for (int i = 0; i < n_int; i++) sim->p.int_sites[i] = i;
+	for (int i = 0; i < N; i++) sim->p.int_idx[i] = -1;
+	for (int m = 0; m < n_int; m++) sim->p.int_idx[sim->p.int_sites[m]] = m;
+	for (int i = 0, m = n_int; i < N; i++)
+		if (sim->p.int_idx[i] < 0) sim->p.int_sites[m++] = i;
+	if (sim->p.ph_sym)
+		my_read(_double, "/params/ph_sign",        sim->p.ph_sign);
 	my_read(_int,    "/params/n_sweep",       &sim->p.n_sweep);
 	my_read( ,       "/state/rng", H5T_NATIVE_UINT64, sim->s.rng);
 	my_read(_int,    "/state/sweep",          &sim->s.sweep);
 	my_read(_int,    "/state/hs",              sim->s.hs);
-	my_read(_int,    "/meas_eqlt/n_sample",   &sim->m_eq.n_sample);
-	my_read( , "/meas_eqlt/sign",        num_h5t, &sim->m_eq.sign);
-	my_read( , "/meas_eqlt/density",     num_h5t, sim->m_eq.density);
-	my_read( , "/meas_eqlt/double_occ",  num_h5t, sim->m_eq.double_occ);
-	my_read( , "/meas_eqlt/g00",         num_h5t, sim->m_eq.g00);
-	my_read( , "/meas_eqlt/nn",          num_h5t, sim->m_eq.nn);
-	my_read( , "/meas_eqlt/xx",          num_h5t, sim->m_eq.xx);
-	my_read( , "/meas_eqlt/zz",          num_h5t, sim->m_eq.zz);
-	my_read( , "/meas_eqlt/pair_sw",     num_h5t, sim->m_eq.pair_sw);
-	if (sim->p.meas_energy_corr) {
-		my_read( , "/meas_eqlt/kk", num_h5t, sim->m_eq.kk);
-		my_read( , "/meas_eqlt/kv", num_h5t, sim->m_eq.kv);
-		my_read( , "/meas_eqlt/kn", num_h5t, sim->m_eq.kn);
-		my_read( , "/meas_eqlt/vv", num_h5t, sim->m_eq.vv);
-		my_read( , "/meas_eqlt/vn", num_h5t, sim->m_eq.vn);
-	}
-	if (sim->p.period_uneqlt > 0) {
-		my_read(_int,    "/meas_uneqlt/n_sample", &sim->m_ue.n_sample);
-		my_read( , "/meas_uneqlt/sign",      num_h5t, &sim->m_ue.sign);
-		my_read( , "/meas_uneqlt/gt0",       num_h5t, sim->m_ue.gt0);
-		my_read( , "/meas_uneqlt/nn",        num_h5t, sim->m_ue.nn);
-		my_read( , "/meas_uneqlt/xx",        num_h5t, sim->m_ue.xx);
-		my_read( , "/meas_uneqlt/zz",        num_h5t, sim->m_ue.zz);
-		my_read( , "/meas_uneqlt/pair_sw",   num_h5t, sim->m_ue.pair_sw);
-		if (sim->p.meas_bond_corr) {
-			my_read( , "/meas_uneqlt/pair_bb", num_h5t, sim->m_ue.pair_bb);
-			my_read( , "/meas_uneqlt/jj",      num_h5t, sim->m_ue.jj);
-			my_read( , "/meas_uneqlt/jsjs",    num_h5t, sim->m_ue.jsjs)
-			my_read( , "/meas_uneqlt/kk",      num_h5t, sim->m_ue.kk);
-			my_read( , "/meas_uneqlt/ksks",    num_h5t, sim->m_ue.ksks);
-		}
-                if (sim->p.meas_3curr) {
- 			my_read(_double, "/meas_uneqlt/jjj", sim->m_ue.jjj);
- 		}
-                if (sim->p.meas_3curr_limit) {
-                        my_read(_double, "/meas_uneqlt/jjj_l", sim->m_ue.jjj_l);
-                }
-		if (sim->p.meas_energy_corr) {
-			my_read( , "/meas_uneqlt/kv", num_h5t, sim->m_ue.kv);
-			my_read( , "/meas_uneqlt/kn", num_h5t, sim->m_ue.kn);
-			my_read( , "/meas_uneqlt/vv", num_h5t, sim->m_ue.vv);
-			my_read( , "/meas_uneqlt/vn", num_h5t, sim->m_ue.vn);
-		}
-		if (sim->p.meas_nematic_corr) {
-			my_read( , "/meas_uneqlt/nem_nnnn", num_h5t, sim->m_ue.nem_nnnn);
-			my_read( , "/meas_uneqlt/nem_ssss", num_h5t, sim->m_ue.nem_ssss);
-		}
+	status = meas_read(file_id, "", &sim->p, &sim->m_eq, &sim->m_ue);
+	return_if(status < 0, -1, "meas_read() failed: %d\n", status);
+
+	// the other walkers of a multi-walker run share the arrays of p.
+	// their measurements start empty, the file's are all in sim. replicas
+	// have their own parameters for U and K, and their own measurements
+	const int replica = (sim->p.replica_period > 0);
+	sim->n_walker = n_walker;
+	sim->id = 0;
+	sim->walker = (n_walker > 1) ?
+	              my_calloc((n_walker - 1) * sizeof(struct sim_data)) : NULL;
+	for (int k = 1; k < n_walker; k++) {
+		struct sim_data *const w = sim->walker + (k - 1);
+		char name[64];
+		w->file = file;
+		w->p = sim->p;
+		w->n_walker = n_walker;
+		w->id = k;
+		w->walker = NULL;
+		w->s.hs = my_calloc(n_int*L * sizeof(int));
+		meas_alloc(&w->p, &w->m_eq, &w->m_ue);
+		snprintf(name, sizeof(name), "/state/walker%d/rng", k);
+		my_read( , name, H5T_NATIVE_UINT64, w->s.rng);
+		snprintf(name, sizeof(name), "/state/walker%d/sweep", k);
+		my_read(_int, name, &w->s.sweep);
+		snprintf(name, sizeof(name), "/state/walker%d/hs", k);
+		my_read(_int, name, w->s.hs);
+		w->prev = (k == 1) ? sim : w - 1;
+		w->next = (k + 1 < n_walker) ? w + 1 : NULL;
+		if (!replica) continue;
+
+#define my_read_replica(field, type) do { \
+	snprintf(name, sizeof(name), "/replica%d/params/" #field, k); \
+	my_read( , name, (type), w->p.field); \
+} while (0);
+
+		w->p.exp_Ku         = my_calloc(N*N * sizeof(num));
+		w->p.exp_Kd         = my_calloc(N*N * sizeof(num));
+		w->p.inv_exp_Ku     = my_calloc(N*N * sizeof(num));
+		w->p.inv_exp_Kd     = my_calloc(N*N * sizeof(num));
+		w->p.exp_halfKu     = my_calloc(N*N * sizeof(num));
+		w->p.exp_halfKd     = my_calloc(N*N * sizeof(num));
+		w->p.inv_exp_halfKu = my_calloc(N*N * sizeof(num));
+		w->p.inv_exp_halfKd = my_calloc(N*N * sizeof(num));
+		w->p.exp_lambda     = my_calloc(N*2 * sizeof(double));
+		w->p.del            = my_calloc(N*2 * sizeof(double));
+		my_read_replica(exp_Ku,         num_h5t);
+		my_read_replica(exp_Kd,         num_h5t);
+		my_read_replica(inv_exp_Ku,     num_h5t);
+		my_read_replica(inv_exp_Kd,     num_h5t);
+		my_read_replica(exp_halfKu,     num_h5t);
+		my_read_replica(exp_halfKd,     num_h5t);
+		my_read_replica(inv_exp_halfKu, num_h5t);
+		my_read_replica(inv_exp_halfKd, num_h5t);
+		my_read_replica(exp_lambda,     H5T_NATIVE_DOUBLE);
+		my_read_replica(del,            H5T_NATIVE_DOUBLE);
+		snprintf(name, sizeof(name), "/replica%d", k);
+		status = meas_read(file_id, name, &w->p, &w->m_eq, &w->m_ue);
+		return_if(status < 0, -1, "meas_read() failed: %d\n", status);
+
+#undef my_read_replica
 	}
+	sim->prev = NULL;
+	sim->next = sim->walker;
 
+#undef my_read_opt
 #undef my_read
 
 	status = H5Fclose(file_id);
@@ -245,54 +639,51 @@ int sim_data_save(const struct sim_data *sim)
 	my_write("/state/rng",            H5T_NATIVE_UINT64,  sim->s.rng);
 	my_write("/state/sweep",          H5T_NATIVE_INT,    &sim->s.sweep);
 	my_write("/state/hs",             H5T_NATIVE_INT,     sim->s.hs);
-	my_write("/meas_eqlt/n_sample",   H5T_NATIVE_INT,    &sim->m_eq.n_sample);
-	my_write("/meas_eqlt/sign",       num_h5t, &sim->m_eq.sign);
-	my_write("/meas_eqlt/density",    num_h5t,  sim->m_eq.density);
-	my_write("/meas_eqlt/double_occ", num_h5t,  sim->m_eq.double_occ);
-	my_write("/meas_eqlt/g00",        num_h5t,  sim->m_eq.g00);
-	my_write("/meas_eqlt/nn",         num_h5t,  sim->m_eq.nn);
-	my_write("/meas_eqlt/xx",         num_h5t,  sim->m_eq.xx);
-	my_write("/meas_eqlt/zz",         num_h5t,  sim->m_eq.zz);
-	my_write("/meas_eqlt/pair_sw",    num_h5t,  sim->m_eq.pair_sw);
-	if (sim->p.meas_energy_corr) {
-		my_write("/meas_eqlt/kk", num_h5t, sim->m_eq.kk);
-		my_write("/meas_eqlt/kv", num_h5t, sim->m_eq.kv);
-		my_write("/meas_eqlt/kn", num_h5t, sim->m_eq.kn);
-		my_write("/meas_eqlt/vv", num_h5t, sim->m_eq.vv);
-		my_write("/meas_eqlt/vn", num_h5t, sim->m_eq.vn);
-	}
-	if (sim->p.period_uneqlt > 0) {
-		my_write("/meas_uneqlt/n_sample", H5T_NATIVE_INT,    &sim->m_ue.n_sample);
-		my_write("/meas_uneqlt/sign",     num_h5t, &sim->m_ue.sign);
-		my_write("/meas_uneqlt/gt0",      num_h5t,  sim->m_ue.gt0);
-		my_write("/meas_uneqlt/nn",       num_h5t,  sim->m_ue.nn);
-		my_write("/meas_uneqlt/xx",       num_h5t,  sim->m_ue.xx);
-		my_write("/meas_uneqlt/zz",       num_h5t,  sim->m_ue.zz);
-		my_write("/meas_uneqlt/pair_sw",  num_h5t,  sim->m_ue.pair_sw);
-		if (sim->p.meas_bond_corr) {
-			my_write("/meas_uneqlt/pair_bb", num_h5t, sim->m_ue.pair_bb);
-			my_write("/meas_uneqlt/jj",      num_h5t, sim->m_ue.jj);
-			my_write("/meas_uneqlt/jsjs",    num_h5t, sim->m_ue.jsjs);
-			my_write("/meas_uneqlt/kk",      num_h5t, sim->m_ue.kk);
-			my_write("/meas_uneqlt/ksks",    num_h5t, sim->m_ue.ksks);
-		}
-                if (sim->p.meas_3curr) {
- 			my_write("/meas_uneqlt/jjj", H5T_NATIVE_DOUBLE, sim->m_ue.jjj);
- 		}
-                if (sim->p.meas_3curr_limit) {
-                        my_write("/meas_uneqlt/jjj_l", H5T_NATIVE_DOUBLE, sim->m_ue.jjj_l);
-                }
-		if (sim->p.meas_energy_corr) {
-			my_write("/meas_uneqlt/kv", num_h5t, sim->m_ue.kv);
-			my_write("/meas_uneqlt/kn", num_h5t, sim->m_ue.kn);
-			my_write("/meas_uneqlt/vv", num_h5t, sim->m_ue.vv);
-			my_write("/meas_uneqlt/vn", num_h5t, sim->m_ue.vn);
-		}
-		if (sim->p.meas_nematic_corr) {
-			my_write("/meas_uneqlt/nem_nnnn", num_h5t, sim->m_ue.nem_nnnn);
-			my_write("/meas_uneqlt/nem_ssss", num_h5t, sim->m_ue.nem_ssss);
+	for (int k = 1; k < sim->n_walker; k++) {
+		const struct sim_data *const w = sim->walker + (k - 1);
+		char name[64];
+		snprintf(name, sizeof(name), "/state/walker%d/rng", k);
+		my_write(name, H5T_NATIVE_UINT64, w->s.rng);
+		snprintf(name, sizeof(name), "/state/walker%d/sweep", k);
+		my_write(name, H5T_NATIVE_INT, &w->s.sweep);
+		snprintf(name, sizeof(name), "/state/walker%d/hs", k);
+		my_write(name, H5T_NATIVE_INT, w->s.hs);
+		if (sim->p.replica_period > 0) {
+			snprintf(name, sizeof(name), "/replica%d", k);
+			status = meas_write(file_id, name, &w->p, &w->m_eq, &w->m_ue);
+			return_if(status < 0, -1, "meas_write() failed: %d\n", status);
 		}
 	}
+	status = meas_write(file_id, "", &sim->p, &sim->m_eq, &sim->m_ue);
+	return_if(status < 0, -1, "meas_write() failed: %d\n", status);
+
+#undef my_write
+
+	status = H5Fclose(file_id);
+	return_if(status < 0, -1, "H5Fclose() failed: %d\n", status);
+	return 0;
+}
+
+int sim_data_save_params(const struct sim_data *sim)
+{
+	const hid_t file_id = H5Fopen(sim->file, H5F_ACC_RDWR, H5P_DEFAULT);
+	return_if(file_id < 0, -1, "H5Fopen() failed: %ld\n", file_id);
+
+	herr_t status;
+	hid_t dset_id;
+
+#define my_write(name, type, data) do { \
+	dset_id = H5Dopen2(file_id, (name), H5P_DEFAULT); \
+	return_if(dset_id < 0, -1, "H5Dopen2() failed for %s: %ld\n", name, dset_id); \
+	status = H5Dwrite(dset_id, (type), H5S_ALL, H5S_ALL, H5P_DEFAULT, (data)); \
+	return_if(status < 0, -1, "H5Dwrite() failed for %s: %d\n", name, status); \
+	status = H5Dclose(dset_id); \
+	return_if(status < 0, -1, "H5Dclose() failed for %s: %d\n", name, status); \
+} while (0);
+
+	my_write("/params/n_matmul",      H5T_NATIVE_INT,    &sim->p.n_matmul);
+	my_write("/params/F",             H5T_NATIVE_INT,    &sim->p.F);
+	my_write("/params/n_delay",       H5T_NATIVE_INT,    &sim->p.n_delay);
 
 #undef my_write
 
@@ -301,53 +692,49 @@ int sim_data_save(const struct sim_data *sim)
 	return 0;
 }
 
+void sim_data_reduce(struct sim_data *sim)
+{
+	if (sim->p.replica_period > 0)
+		return;
+	for (int k = 1; k < sim->n_walker; k++) {
+		struct sim_data *const w = sim->walker + (k - 1);
+		meas_add(&sim->p, &sim->m_eq, &sim->m_ue, &w->m_eq, &w->m_ue);
+	}
+}
+
 void sim_data_free(const struct sim_data *sim)
 {
-	if (sim->p.period_uneqlt > 0) {
-		if (sim->p.meas_nematic_corr) {
-			my_free(sim->m_ue.nem_ssss);
-			my_free(sim->m_ue.nem_nnnn);
-		}
-		if (sim->p.meas_energy_corr) {
-			my_free(sim->m_ue.vn);
-			my_free(sim->m_ue.vv);
-			my_free(sim->m_ue.kn);
-			my_free(sim->m_ue.kv);
-		}
-                if (sim->p.meas_3curr) {
- 			my_free(sim->m_ue.jjj);
- 		}
-                if (sim->p.meas_3curr_limit) {
-                        my_free(sim->m_ue.jjj_l);
-                }
-		if (sim->p.meas_bond_corr) {
-			my_free(sim->m_ue.ksks);
-			my_free(sim->m_ue.kk);
-			my_free(sim->m_ue.jsjs);
-			my_free(sim->m_ue.jj);
-			my_free(sim->m_ue.pair_bb);
+	for (int k = 1; k < sim->n_walker; k++) {
+		const struct sim_data *const w = sim->walker + (k - 1);
+		meas_free(&w->p, &w->m_eq, &w->m_ue);
+		my_free(w->s.hs);
+		if (sim->p.replica_period > 0 && w->p.exp_Ku != sim->p.exp_Ku) {
+			my_free(w->p.del);
+			my_free(w->p.exp_lambda);
+			my_free(w->p.inv_exp_halfKd);
+			my_free(w->p.inv_exp_halfKu);
+			my_free(w->p.exp_halfKd);
+			my_free(w->p.exp_halfKu);
+			my_free(w->p.inv_exp_Kd);
+			my_free(w->p.inv_exp_Ku);
+			my_free(w->p.exp_Kd);
+			my_free(w->p.exp_Ku);
 		}
-		my_free(sim->m_ue.pair_sw);
-		my_free(sim->m_ue.zz);
-		my_free(sim->m_ue.xx);
-		my_free(sim->m_ue.nn);
-		my_free(sim->m_ue.gt0);
 	}
-	if (sim->p.meas_energy_corr) {
-		my_free(sim->m_eq.vn);
-		my_free(sim->m_eq.vv);
-		my_free(sim->m_eq.kn);
-		my_free(sim->m_eq.kv);
-		my_free(sim->m_eq.kk);
+	my_free(sim->walker);
+	meas_free(&sim->p, &sim->m_eq, &sim->m_ue);
+	if (sim->p.checkerboard) {
+		my_free(sim->p.cb_dd);
+		my_free(sim->p.cb_du);
+		my_free(sim->p.cb_md);
+		my_free(sim->p.cb_mu);
+		my_free(sim->p.cb_bonds);
+		my_free(sim->p.cb_group);
 	}
-	my_free(sim->m_eq.pair_sw);
-	my_free(sim->m_eq.zz);
-	my_free(sim->m_eq.xx);
-	my_free(sim->m_eq.nn);
-	my_free(sim->m_eq.g00);
-	my_free(sim->m_eq.double_occ);
-	my_free(sim->m_eq.density);
 	my_free(sim->s.hs);
+	my_free(sim->p.ph_sign);
+	my_free(sim->p.int_idx);
+	my_free(sim->p.int_sites);
 	my_free(sim->p.del);
 	my_free(sim->p.exp_lambda);
 	my_free(sim->p.inv_exp_halfKd);
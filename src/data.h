@@ -12,10 +12,22 @@ struct params {
 //	double *K, *U;
 //	double dt;
 
-	int n_matmul, n_delay;
+	int n_matmul, n_delay, n_delay_inner;
+	int update_method;
+	int udt_stack, stab;
+	double wrap_tol;
 	int n_sweep_warm, n_sweep_meas;
+	// global moves flipping a site (global_cluster: and its bonded
+	// neighbours) in every slice, tried every global_period sweeps
+	int global_period, global_cluster;
+	// replica exchange between neighbouring walkers every replica_period
+	// sweeps
+	int replica_period;
 	int period_eqlt, period_uneqlt;
 	int meas_bond_corr, meas_3curr, meas_3curr_limit, meas_energy_corr, meas_nematic_corr;
+	// if > 0, jjj is estimated from jjj_n_sample random bond triples per
+	// measurement instead of all num_b^3
+	int jjj_n_sample;
 
 	int num_i, num_ij;
 	int num_b, num_bs, num_bb, num_bbb, num_bbb_lim;
@@ -24,12 +36,42 @@ struct params {
 	num *exp_halfKu, *exp_halfKd, *inv_exp_halfKu, *inv_exp_halfKd;
 	double *exp_lambda, *del;
 	int F, n_sweep;
+
+	// the HS fields live on the n_int interacting sites int_sites[0 ..
+	// n_int-1] only: hs[m + n_int*l] is the field of site int_sites[m].
+	// int_sites[n_int .. N-1] are the others, where exp_lambda = 1 and
+	// del = 0. int_idx[i] is the position of site i in int_sites, or -1
+	int n_int;
+	int *int_sites, *int_idx;
+
+	// particle-hole symmetry (bipartite lattice, mu = 0): gd = I - S gu^T S
+	// with S = diag(ph_sign), so only spin up is propagated
+	int ph_sym;
+	double *ph_sign;
+
+	// checkerboard decomposition of exp_K, see cb.h. first index selects
+	// exp(-dt K) (0) or its inverse (1)
+	int checkerboard, cb_n_group, cb_n_bond;
+	int *cb_group, *cb_bonds;
+	num *cb_mu, *cb_md;         // 2 x n_bond x 2 x 2
+	double *cb_du, *cb_dd;      // 2 x N
+
+	// FFT exp_K for translation invariant K on an Nx x Ny lattice, see fftk.h
+	int fft_K, Nx, Ny;
+	// 2 site measurements by displacement r = rx + Nx*ry (map_ij not used,
+	// needs num_ij = N), with 2D FFTs for the convolutions and for the
+	// structure factors written alongside, see fftm.h
+	int meas_fft;
 };
 
 struct state {
 	uint64_t rng[17];
 	int sweep;
-	int *hs;
+	int *hs;        // L x n_int
+	// proposed and accepted global moves and swaps with the next replica
+	// in this run, for the log. not saved
+	int n_global, n_global_acc;
+	int n_swap, n_swap_acc;
 };
 
 struct meas_eqlt {
@@ -60,6 +102,7 @@ struct meas_uneqlt {
 	num *jj, *jsjs;
 	num *kk, *ksks;
         num *jjj,*jjj_l;
+	int *jjj_n; // sampled triples per map_bbb class, if jjj_n_sample > 0
 	num *kv, *kn, *vv, *vn;
 	num *nem_nnnn, *nem_ssss;
 };
@@ -70,10 +113,37 @@ struct sim_data {
 	struct state s;
 	struct meas_eqlt m_eq;
 	struct meas_uneqlt m_ue;
+
+	// multi-walker runs (/params/n_walker > 1): walker[k-1] is chain k,
+	// with its own state and measurements but sharing the arrays of p.
+	// this is chain 0 (id 0), read from and saved to /state
+	int n_walker, id;
+	struct sim_data *walker;
+
+	// with replica_period > 0, walker k has its own exp_lambda, del and
+	// exp_K's from /replica<k>/params and measures into /replica<k>.
+	// prev and next are the neighbouring replicas. lw_self and lw_swap
+	// are log|weight| of this replica's and its partner's fields with this
+	// replica's parameters, and swap the decision of the lower replica
+	struct sim_data *prev, *next;
+	double lw_self, lw_swap;
+	int swap;
+
+	// largest difference between wrapped and recalculated g in the last
+	// call of dqmc(). measured with wrap_tol > 0, or if check_wrp is set
+	int check_wrp;
+	double wrap_err;
 };
 
 int sim_data_read_alloc(struct sim_data *sim, const char *file);
 
 int sim_data_save(const struct sim_data *sim);
 
+// writes n_matmul, F and n_delay back to /params (dqmc_1 -T)
+int sim_data_save_params(const struct sim_data *sim);
+
+// adds the measurements of the other walkers into sim->m_eq, sim->m_ue.
+// does nothing for replicas, which keep their own
+void sim_data_reduce(struct sim_data *sim);
+
 void sim_data_free(const struct sim_data *sim);
@@ -1,7 +1,12 @@
 #include "dqmc.h"
 #include <tgmath.h>
 #include <stdio.h>
+#include <omp.h>
+#include <unistd.h>
+#include "cb.h"
 #include "data.h"
+#include "fftk.h"
+#include "fftm.h"
 #include "greens.h"
 #include "linalg.h"
 #include "meas.h"
@@ -28,38 +33,234 @@
 	xgemm("N", "N", N, N, N, 1.0, (A), N, (B), N, 0.0, (C), N); \
 } while (0);
 
+// the diagonals only differ from 1 at the interacting sites, see params
 #define calcBu(B, l) do { \
-	for (int j = 0; j < N; j++) { \
-		const double el = exp_lambda[j + N*hs[j + N*(l)]]; \
+	my_copy((B), exp_Ku, N*N); \
+	for (int m = 0; m < n_int; m++) { \
+		const int j = int_sites[m]; \
+		const double el = exp_lambda[j + N*hs[m + n_int*(l)]]; \
 		for (int i = 0; i < N; i++) \
-			(B)[i + N*j] = exp_Ku[i + N*j] * el; \
+			(B)[i + N*j] *= el; \
 	} \
 } while (0);
 
 #define calcBd(B, l) do { \
-	for (int j = 0; j < N; j++) { \
-		const double el = exp_lambda[j + N*!hs[j + N*(l)]]; \
+	my_copy((B), exp_Kd, N*N); \
+	for (int m = 0; m < n_int; m++) { \
+		const int j = int_sites[m]; \
+		const double el = exp_lambda[j + N*!hs[m + n_int*(l)]]; \
 		for (int i = 0; i < N; i++) \
-			(B)[i + N*j] = exp_Kd[i + N*j] * el; \
+			(B)[i + N*j] *= el; \
 	} \
 } while (0);
 
+// B_l = exp_K diag(exp_lambda[hs_l]) and its inverse are never stored; all
+// products below apply exp_K (dense, checkerboard or FFT) and the diagonal
+// separately
+
 #define calciBu(iB, l) do { \
-	for (int i = 0; i < N; i++) { \
-		const double el = exp_lambda[i + N*!hs[i + N*(l)]]; \
-		for (int j = 0; j < N; j++) \
-			(iB)[i + N*j] = el * inv_exp_Ku[i + N*j]; \
+	my_copy((iB), inv_exp_Ku, N*N); \
+	for (int j = 0; j < N; j++) \
+	for (int m = 0; m < n_int; m++) { \
+		const int i = int_sites[m]; \
+		(iB)[i + N*j] *= exp_lambda[i + N*!hs[m + n_int*(l)]]; \
 	} \
 } while (0);
 
 #define calciBd(iB, l) do { \
-	for (int i = 0; i < N; i++) { \
-		const double el = exp_lambda[i + N*hs[i + N*(l)]]; \
+	my_copy((iB), inv_exp_Kd, N*N); \
+	for (int j = 0; j < N; j++) \
+	for (int m = 0; m < n_int; m++) { \
+		const int i = int_sites[m]; \
+		(iB)[i + N*j] *= exp_lambda[i + N*hs[m + n_int*(l)]]; \
+	} \
+} while (0);
+
+// A = M A and A = A M for M = exp_K (w = K) or inv_exp_K (w = iK), with
+// the checkerboard or FFT propagator
+#define sp_lmulu(w, A) do { \
+	if (cb) cb_lmul(N, &cb_##w##u, (A)); \
+	else fftk_lmul(&fftku, FFTK_##w, (A)); \
+} while (0);
+
+#define sp_lmuld(w, A) do { \
+	if (cb) cb_lmul(N, &cb_##w##d, (A)); \
+	else fftk_lmul(&fftkd, FFTK_##w, (A)); \
+} while (0);
+
+#define sp_rmulu(w, A) do { \
+	if (cb) cb_rmul(N, &cb_##w##u, (A)); \
+	else fftk_rmul(&fftku, FFTK_##w, (A)); \
+} while (0);
+
+#define sp_rmuld(w, A) do { \
+	if (cb) cb_rmul(N, &cb_##w##d, (A)); \
+	else fftk_rmul(&fftkd, FFTK_##w, (A)); \
+} while (0);
+
+// C_f = B_{(f+1)n_matmul-1} ... B_{f n_matmul}
+#define calcCu(C, f) do { \
+	calcBu((C), (f)*n_matmul); \
+	for (int k = (f)*n_matmul + 1; k < ((f) + 1)*n_matmul; k++) { \
+		for (int j = 0; j < N; j++) \
+		for (int m = 0; m < n_int; m++) { \
+			const int i = int_sites[m]; \
+			(C)[i + N*j] *= exp_lambda[i + N*hs[m + n_int*k]]; \
+		} \
+		if (sparse_K) { \
+			sp_lmulu(K, (C)); \
+		} else { \
+			matmul(tmpNN1u, exp_Ku, (C)); \
+			my_copy((C), tmpNN1u, N*N); \
+		} \
+	} \
+} while (0);
+
+#define calcCd(C, f) do { \
+	calcBd((C), (f)*n_matmul); \
+	for (int k = (f)*n_matmul + 1; k < ((f) + 1)*n_matmul; k++) { \
 		for (int j = 0; j < N; j++) \
-			(iB)[i + N*j] = el * inv_exp_Kd[i + N*j]; \
+		for (int m = 0; m < n_int; m++) { \
+			const int i = int_sites[m]; \
+			(C)[i + N*j] *= exp_lambda[i + N*!hs[m + n_int*k]]; \
+		} \
+		if (sparse_K) { \
+			sp_lmuld(K, (C)); \
+		} else { \
+			matmul(tmpNN1d, exp_Kd, (C)); \
+			my_copy((C), tmpNN1d, N*N); \
+		} \
 	} \
 } while (0);
 
+// g = D_l g D_l^-1 and g = D_l^-1 g D_l, D_l = diag(exp_lambda[hs_l]). the
+// two diagonals are applied in one pass over g. entries with neither row
+// nor column at an interacting site are left alone
+#define diag_wrapu(g, l) do { \
+	for (int j = 0; j < N; j++) { \
+		const int mj = int_idx[j]; \
+		const double elj = (mj < 0) ? 1.0 : \
+		                   exp_lambda[j + N*!hs[mj + n_int*(l)]]; \
+		for (int m = 0; m < n_int; m++) { \
+			const int i = int_sites[m]; \
+			(g)[i + N*j] *= exp_lambda[i + N*hs[m + n_int*(l)]] * elj; \
+		} \
+		if (mj >= 0) \
+			for (int m = n_int; m < N; m++) \
+				(g)[int_sites[m] + N*j] *= elj; \
+	} \
+} while (0);
+
+#define diag_wrapd(g, l) do { \
+	for (int j = 0; j < N; j++) { \
+		const int mj = int_idx[j]; \
+		const double elj = (mj < 0) ? 1.0 : \
+		                   exp_lambda[j + N*hs[mj + n_int*(l)]]; \
+		for (int m = 0; m < n_int; m++) { \
+			const int i = int_sites[m]; \
+			(g)[i + N*j] *= exp_lambda[i + N*!hs[m + n_int*(l)]] * elj; \
+		} \
+		if (mj >= 0) \
+			for (int m = n_int; m < N; m++) \
+				(g)[int_sites[m] + N*j] *= elj; \
+	} \
+} while (0);
+
+#define diag_bwrapu(g, l) diag_wrapd(g, l)
+#define diag_bwrapd(g, l) diag_wrapu(g, l)
+
+// g = B_l g iB_l = exp_K (D_l g D_l^-1) inv_exp_K
+#define wrapu(g, l) do { \
+	diag_wrapu((g), (l)); \
+	if (sparse_K) { \
+		sp_lmulu(K, (g)); \
+		sp_rmulu(iK, (g)); \
+	} else { \
+		matmul(tmpNN1u, exp_Ku, (g)); \
+		matmul((g), tmpNN1u, inv_exp_Ku); \
+	} \
+} while (0);
+
+#define wrapd(g, l) do { \
+	diag_wrapd((g), (l)); \
+	if (sparse_K) { \
+		sp_lmuld(K, (g)); \
+		sp_rmuld(iK, (g)); \
+	} else { \
+		matmul(tmpNN1d, exp_Kd, (g)); \
+		matmul((g), tmpNN1d, inv_exp_Kd); \
+	} \
+} while (0);
+
+// g = iB_l g B_l = D_l^-1 (inv_exp_K g exp_K) D_l
+#define bwrapu(g, l) do { \
+	if (sparse_K) { \
+		sp_lmulu(iK, (g)); \
+		sp_rmulu(K, (g)); \
+	} else { \
+		matmul(tmpNN1u, inv_exp_Ku, (g)); \
+		matmul((g), tmpNN1u, exp_Ku); \
+	} \
+	diag_bwrapu((g), (l)); \
+} while (0);
+
+#define bwrapd(g, l) do { \
+	if (sparse_K) { \
+		sp_lmuld(iK, (g)); \
+		sp_rmuld(K, (g)); \
+	} else { \
+		matmul(tmpNN1d, inv_exp_Kd, (g)); \
+		matmul((g), tmpNN1d, exp_Kd); \
+	} \
+	diag_bwrapd((g), (l)); \
+} while (0);
+
+// dst = inv_exp_halfK src exp_halfK
+#define half_wrapu(dst, src) do { \
+	if (fft_K) { \
+		my_copy((dst), (src), N*N); \
+		fftk_lmul(&fftku, FFTK_ihK, (dst)); \
+		fftk_rmul(&fftku, FFTK_hK, (dst)); \
+	} else { \
+		matmul(tmpNN1u, (src), exp_halfKu); \
+		matmul((dst), inv_exp_halfKu, tmpNN1u); \
+	} \
+} while (0);
+
+#define half_wrapd(dst, src) do { \
+	if (fft_K) { \
+		my_copy((dst), (src), N*N); \
+		fftk_lmul(&fftkd, FFTK_ihK, (dst)); \
+		fftk_rmul(&fftkd, FFTK_hK, (dst)); \
+	} else { \
+		matmul(tmpNN1d, (src), exp_halfKd); \
+		matmul((dst), inv_exp_halfKd, tmpNN1d); \
+	} \
+} while (0);
+
+// hB_l = inv_exp_halfK B_l exp_halfK and hiB_l from scratch
+#define calchBu(l) do { \
+	calcBu(tmpNN2u, (l)); \
+	half_wrapu(hBu + N*N*(l), tmpNN2u); \
+	calciBu(tmpNN2u, (l)); \
+	half_wrapu(hiBu + N*N*(l), tmpNN2u); \
+} while (0);
+
+#define calchBd(l) do { \
+	calcBd(tmpNN2d, (l)); \
+	half_wrapd(hBd + N*N*(l), tmpNN2d); \
+	calciBd(tmpNN2d, (l)); \
+	half_wrapd(hiBd + N*N*(l), tmpNN2d); \
+} while (0);
+
+// particle-hole partner of the spin up g: gd = I - S gu^T S, S = diag(ph_sign).
+// holds in every frame, since S exp_K^T S = inv_exp_K
+#define ph_gd(gd, gu) do { \
+	for (int j = 0; j < N; j++) \
+	for (int i = 0; i < N; i++) \
+		(gd)[i + N*j] = (i == j) - ph_sign[i]*ph_sign[j]*(gu)[j + N*i]; \
+} while (0);
+
 #define matdiff(m, n, A, ldA, B, ldB) do { \
 	double max = 0.0, avg = 0.0; \
 	for (int j = 0; j < (n); j++) \
@@ -72,13 +273,117 @@
 	printf(#A " - " #B ":\tmax %.3e\tavg %.3e\n", max, avg); \
 } while (0);
 
+static double max_diff(const int n, const num *const restrict A,
+		const num *const restrict B)
+{
+	double max = 0.0;
+	for (int i = 0; i < n; i++) {
+		const double diff = fabs(A[i] - B[i]);
+		if (diff > max) max = diff;
+	}
+	return max;
+}
+
+// Ad = a I + b S Au^T S for n x n Au made of N x N blocks, S = diag(s) on
+// each block. with particle-hole symmetry, this gives the spin down
+// unequal-time G from the spin up one (a = delta, b = -1, transposed in
+// time), and hB_d, hiB_d from hiB_u, hB_u (a = 0, b = 1)
+static void ph_transpose(const int N, const int n, const double *const restrict s,
+		const num a, const num b, const num *const restrict Au,
+		num *const restrict Ad)
+{
+	for (int j = 0; j < n; j++)
+	for (int i = 0; i < n; i++)
+		Ad[i + n*j] = (i == j)*a + b*s[i % N]*s[j % N]*Au[j + n*i];
+}
+
+// sum of log exp_lambda over the spin up fields of all slices. with
+// particle-hole symmetry, log|det M_d| = log|det M_u| - this, up to a
+// constant
+static double ph_log_v(const int N, const int L, const int n_int,
+		const int *const restrict int_sites, const int *const restrict hs,
+		const double *const restrict exp_lambda)
+{
+	double sum = 0.0;
+	for (int l = 0; l < L; l++)
+		for (int m = 0; m < n_int; m++) {
+			const int i = int_sites[m];
+			sum += log(exp_lambda[i + N*hs[m + n_int*l]]);
+		}
+	return sum;
+}
+
+// build both UDT stacks from scratch, given the F products in C
+static void udt_stack_build(const int N, const int F, const int stab,
+		const num *const restrict C,
+		num *const restrict R, num *const restrict Lh,
+		num *const restrict tmpNN, num *const restrict tmpN,
+		int *const restrict pvt,
+		num *const restrict work, const int lwork)
+{
+	udt_identity(N, R);
+	for (int f = 0; f < F; f++)
+		udt_push(N, stab, "N", C + N*N*f, R + UDT_SIZE(N)*f,
+		         R + UDT_SIZE(N)*(f + 1), tmpNN,
+		         tmpN, pvt, work, lwork);
+	udt_identity(N, Lh + UDT_SIZE(N)*F);
+	for (int f = F - 1; f >= 0; f--)
+		udt_push(N, stab, "C", C + N*N*f, Lh + UDT_SIZE(N)*(f + 1),
+		         Lh + UDT_SIZE(N)*f, tmpNN,
+		         tmpN, pvt, work, lwork);
+}
+
+// update hB = ihK B hK and hiB = ihK iB hK of one slice after the sites
+// int_sites[flip[0 .. n_flip-1]] were flipped, as rank n_flip corrections.
+// P = ihK exp_K and Q = inv_exp_K hK. s = 0 for spin up, 1 for spin down
+static void half_b_flip(const int N, const int n_flip,
+		const int *const restrict flip, const int s,
+		const int *const restrict int_sites,
+		const int *const restrict hs, const double *const restrict exp_lambda,
+		const num *const restrict P, const num *const restrict hK,
+		const num *const restrict ihK, const num *const restrict Q,
+		num *const restrict hB, num *const restrict hiB,
+		num *const restrict U, num *const restrict V)
+{
+	if (n_flip == 0) return;
+
+	// the change of exp_lambda in column j of B; the one of iB is -dl
+	// since exp_lambda[j + N] = 1/exp_lambda[j]
+	for (int k = 0; k < n_flip; k++) {
+		const int m = flip[k], j = int_sites[m];
+		const double dl = exp_lambda[j + N*(hs[m] ^ s)] -
+		                  exp_lambda[j + N*!(hs[m] ^ s)];
+		for (int i = 0; i < N; i++) U[i + N*k] = dl * P[i + N*j];
+		for (int i = 0; i < N; i++) V[k + n_flip*i] = hK[j + N*i];
+	}
+	xgemm("N", "N", N, N, n_flip, 1.0, U, N, V, n_flip, 1.0, hB, N);
+
+	for (int k = 0; k < n_flip; k++) {
+		const int m = flip[k], j = int_sites[m];
+		const double dl = exp_lambda[j + N*(hs[m] ^ s)] -
+		                  exp_lambda[j + N*!(hs[m] ^ s)];
+		for (int i = 0; i < N; i++) U[i + N*k] = -dl * ihK[i + N*j];
+		for (int i = 0; i < N; i++) V[k + n_flip*i] = Q[j + N*i];
+	}
+	xgemm("N", "N", N, N, n_flip, 1.0, U, N, V, n_flip, 1.0, hiB, N);
+}
+
 static int dqmc(struct sim_data *sim)
 {
 	const int N = sim->p.N;
 	const int L = sim->p.L;
-	const int n_matmul = sim->p.n_matmul;
 	const int n_delay = sim->p.n_delay;
-	const int F = sim->p.F;
+	const int stab = sim->p.stab;
+
+	// with wrap_tol > 0, n_matmul (and with it F and the grouping of
+	// Cu, Cd) is adjusted after each sweep to keep the difference between
+	// wrapped and recalculated g below wrap_tol
+	const int adapt = sim->p.wrap_tol > 0.0;
+	int n_matmul = sim->p.n_matmul;
+	int F = sim->p.F;
+	const int F_max = adapt ? L : F;
+	const int n_matmul_max = sim->p.period_uneqlt > 0 ? n_matmul : L;
+	double wrap_err = 0.0;
 	const num *const restrict exp_Ku = sim->p.exp_Ku;
 	const num *const restrict exp_Kd = sim->p.exp_Kd;
 	const num *const restrict inv_exp_Ku = sim->p.inv_exp_Ku;
@@ -91,34 +396,120 @@ static int dqmc(struct sim_data *sim)
 	const double *const restrict del = sim->p.del;
 	uint64_t *const restrict rng = sim->s.rng;
 	int *const restrict hs = sim->s.hs;
+	const int n_int = sim->p.n_int;
+	const int *const restrict int_sites = sim->p.int_sites;
+	const int *const restrict int_idx = sim->p.int_idx;
+
+	// checkerboard exp_K and inv_exp_K, for wraps and products of B
+	const int cb = sim->p.checkerboard;
+	const int cb_nb = sim->p.cb_n_bond;
+	const struct cb cb_Ku = {sim->p.cb_n_group, cb_nb, sim->p.cb_group,
+		sim->p.cb_bonds, sim->p.cb_mu, sim->p.cb_du};
+	const struct cb cb_Kd = {sim->p.cb_n_group, cb_nb, sim->p.cb_group,
+		sim->p.cb_bonds, sim->p.cb_md, sim->p.cb_dd};
+	const struct cb cb_iKu = {sim->p.cb_n_group, cb_nb, sim->p.cb_group,
+		sim->p.cb_bonds, cb ? sim->p.cb_mu + 4*cb_nb : NULL,
+		cb ? sim->p.cb_du + N : NULL};
+	const struct cb cb_iKd = {sim->p.cb_n_group, cb_nb, sim->p.cb_group,
+		sim->p.cb_bonds, cb ? sim->p.cb_md + 4*cb_nb : NULL,
+		cb ? sim->p.cb_dd + N : NULL};
+
+	// FFT exp_K, for translation invariant K
+	struct fftk fftku, fftkd;
+	int fft_K = !cb && sim->p.fft_K;
+	if (fft_K) {
+		const int su = fftk_init(&fftku, sim->p.Nx, sim->p.Ny, exp_Ku,
+		                         inv_exp_Ku, exp_halfKu, inv_exp_halfKu);
+		const int sd = fftk_init(&fftkd, sim->p.Nx, sim->p.Ny, exp_Kd,
+		                         inv_exp_Kd, exp_halfKd, inv_exp_halfKd);
+		if (su < 0 || sd < 0) {
+			fprintf(stderr, "fftk_init() failed; fft_K disabled\n");
+			if (su == 0) fftk_free(&fftku);
+			if (sd == 0) fftk_free(&fftkd);
+			fft_K = 0;
+		}
+	}
+	const int sparse_K = cb || fft_K;
+
+	// descriptors of the FFT measurements, kept until the end of the run
+	if (sim->p.meas_fft && fftm_init(sim->p.Nx, sim->p.Ny, L) < 0) {
+		fprintf(stderr, "fftm_init() failed; meas_fft disabled\n");
+		sim->p.meas_fft = 0;
+	}
+
+	// particle-hole symmetry: only spin up is propagated and updated. gd
+	// and the spin down unequal-time G are derived when measuring
+	const int ph = sim->p.ph_sym;
+	const double *const restrict ph_sign = sim->p.ph_sign;
+
+	num *const Cu = my_calloc(N*N*F_max * sizeof(num));
+	num *const Cd = !ph ? my_calloc(N*N*F_max * sizeof(num)) : NULL;
+
+	// B and C matrices wrapped by e^K/2, only for uneq G calculation
+	const int ue = sim->p.period_uneqlt > 0;
+	num *const hBu = ue ? my_calloc(N*N*L * sizeof(num)) : NULL;
+	num *const hBd = ue ? my_calloc(N*N*L * sizeof(num)) : NULL;
+	num *const hiBu = ue ? my_calloc(N*N*L * sizeof(num)) : NULL;
+	num *const hiBd = ue ? my_calloc(N*N*L * sizeof(num)) : NULL;
+	num *const hCu = ue ? my_calloc(N*N*F_max * sizeof(num)) : NULL;
+	num *const hCd = (ue && !ph) ? my_calloc(N*N*F_max * sizeof(num)) : NULL;
+	// hB and hiB are kept up to date after each update by rank-n_flip
+	// corrections, using P = ihK exp_K and Q = inv_exp_K hK. a slice is
+	// recalculated from scratch once N flips have accumulated in it
+	num *const hPu = ue ? my_calloc(N*N * sizeof(num)) : NULL;
+	num *const hPd = (ue && !ph) ? my_calloc(N*N * sizeof(num)) : NULL;
+	num *const hQu = ue ? my_calloc(N*N * sizeof(num)) : NULL;
+	num *const hQd = (ue && !ph) ? my_calloc(N*N * sizeof(num)) : NULL;
+	int *const flip = ue ? my_calloc(N * sizeof(int)) : NULL;
+	int *const hB_n_flip = ue ? my_calloc(L * sizeof(int)) : NULL;
 
-	num *const Bu = my_calloc(N*N*L * sizeof(num));
-	num *const Bd = my_calloc(N*N*L * sizeof(num));
-	num *const iBu = my_calloc(N*N*L * sizeof(num));
-	num *const iBd = my_calloc(N*N*L * sizeof(num));
-	num *const Cu = my_calloc(N*N*F * sizeof(num));
-	num *const Cd = my_calloc(N*N*F * sizeof(num));
-
-	// B and C matrices wrapped by e^K/2, for uneq G calculation
-	num *const hBu = my_calloc(N*N*L * sizeof(num));
-	num *const hBd = my_calloc(N*N*L * sizeof(num));
-	num *const hiBu = my_calloc(N*N*L * sizeof(num));
-	num *const hiBd = my_calloc(N*N*L * sizeof(num));
-	num *const hCu = my_calloc(N*N*F * sizeof(num));
-	num *const hCd = my_calloc(N*N*F * sizeof(num));
+	// UDT stacks: R[f] = C_{f-1}...C_0 and L[f] = (C_{F-1}...C_f)^H
+	num *const Ru = sim->p.udt_stack ? my_calloc(UDT_SIZE(N)*(F_max + 1) * sizeof(num)) : NULL;
+	num *const Lu = sim->p.udt_stack ? my_calloc(UDT_SIZE(N)*(F_max + 1) * sizeof(num)) : NULL;
+	num *const Rd = (sim->p.udt_stack && !ph) ? my_calloc(UDT_SIZE(N)*(F_max + 1) * sizeof(num)) : NULL;
+	num *const Ld = (sim->p.udt_stack && !ph) ? my_calloc(UDT_SIZE(N)*(F_max + 1) * sizeof(num)) : NULL;
 
 	num *const restrict gu = my_calloc(N*N * sizeof(num));
 	num *const restrict gd = my_calloc(N*N * sizeof(num));
+	// wrapped g at each recalc, to compare with the recalculated one
 	#ifdef CHECK_G_WRP
-	num *const restrict guwrp = my_calloc(N*N * sizeof(num));
-	num *const restrict gdwrp = my_calloc(N*N * sizeof(num));
+	const int check_wrp = 1;
+	#else
+	const int check_wrp = adapt || sim->check_wrp;
 	#endif
+	num *const restrict guwrp = check_wrp ? my_calloc(N*N * sizeof(num)) : NULL;
+	num *const restrict gdwrp = check_wrp ? my_calloc(N*N * sizeof(num)) : NULL;
 	#ifdef CHECK_G_ACC
 	num *const restrict guacc = my_calloc(N*N * sizeof(num));
 	num *const restrict gdacc = my_calloc(N*N * sizeof(num));
+	// every B, for the reference calculation
+	num *const restrict Bu = my_calloc(N*N*L * sizeof(num));
+	num *const restrict Bd = my_calloc(N*N*L * sizeof(num));
+	for (int l = 0; l < L; l++) {
+		calcBu(Bu + N*N*l, l);
+		calcBd(Bd + N*N*l, l);
+	}
 	#endif
 	num phase;
+	// log|det(I + B_L-1 ... B_0)| of gu and gd from their last
+	// recalculation. after a sweep that is the one at t = 0, so the global
+	// moves and replica swaps below get the old weight without computing it
+	double ldu = 0.0, ldd = 0.0;
 	int *const site_order = my_calloc(N * sizeof(double));
+	// uniforms for the proposals of one slice, drawn at once. sites with
+	// del = 0 (U = 0) are never proposed and take none
+	double *const restrict rand_u = my_calloc(N * sizeof(double));
+	int n_rand_u = 0;
+	for (int m = 0; m < n_int; m++) {
+		const int i = int_sites[m];
+		n_rand_u += (del[i] != 0.0 || del[i + N] != 0.0);
+	}
+
+	// the slices of a sweep run on a team of a spin up and a spin down
+	// thread, bound to neighbouring places (e.g. cores, with OMP_PLACES),
+	// that meet at sb. with ph_sym there is no spin down thread
+	const int n_spin = (ph || omp_get_max_threads() < 2) ? 1 : 2;
+	struct spin_barrier sb;
 
 	// work arrays for calc_eq_g and stuff. two sets for easy 2x parallelization
 	num *const restrict tmpNN1u = my_calloc(N*N * sizeof(num));
@@ -135,195 +526,365 @@ static int dqmc(struct sim_data *sim)
 	num *const restrict tmpN3d = my_calloc(N * sizeof(num));
 	int *const restrict pvtd = my_calloc(N * sizeof(int));
 
-	// arrays for calc_ue_g
-// 	num *restrict Gu0t = NULL;
-// 	num *restrict Gutt = NULL;
-// 	num *restrict Gut0 = NULL;
-	num *restrict ueGu = NULL;
+	// submatrix updates use the tmpNN and tmpN arrays above, plus these.
+	// the block size q = n_delay is capped at N to fit them; no more than
+	// n_int <= N flips are pending per slice anyway
+	const int submat = sim->p.update_method == UPDATE_SUBMAT;
+	const int q = n_delay < N ? n_delay : N;
+	num *const restrict LUu = submat ? my_calloc(q*q * sizeof(num)) : NULL;
+	num *const restrict LUd = submat ? my_calloc(q*q * sizeof(num)) : NULL;
+	int *const restrict submat_r = submat ? my_calloc((q + 1) * sizeof(int)) : NULL;
+	// look-ahead columns and rows for two-level delayed updates
+	const int n_inner = submat ? 0 : sim->p.n_delay_inner;
+	num *const restrict lau = n_inner ? my_calloc(2*N*n_inner * sizeof(num)) : NULL;
+	num *const restrict lad = n_inner ? my_calloc(2*N*n_inner * sizeof(num)) : NULL;
+	num *const restrict lwu = n_inner ? my_calloc(n_inner*n_delay * sizeof(num)) : NULL;
+	num *const restrict lwd = n_inner ? my_calloc(n_inner*n_delay * sizeof(num)) : NULL;
+
+	// arrays for calc_ue_g. G(0,t), G(t,t) and G(t,0) suffice unless a
+	// 3-current measurement needs arbitrary (t, t') blocks
+	const int ue_full = sim->p.meas_3curr || sim->p.meas_3curr_limit;
+	num *restrict Gu0t = NULL;
+	num *restrict Gutt = NULL;
+	num *restrict Gut0 = NULL;
 	num *restrict Gredu = NULL;
 	num *restrict tauu = NULL;
 	num *restrict Qu = NULL;
 
-// 	num *restrict Gd0t = NULL;
-// 	num *restrict Gdtt = NULL;
-// 	num *restrict Gdt0 = NULL;
-	num *restrict ueGd = NULL;
+	num *restrict Gd0t = NULL;
+	num *restrict Gdtt = NULL;
+	num *restrict Gdt0 = NULL;
 	num *restrict Gredd = NULL;
 	num *restrict taud = NULL;
 	num *restrict Qd = NULL;
+	struct ue_full_work uew = {0};
+	struct meas_fft_work mfw = {0};
+	if (sim->p.meas_fft)
+		meas_fft_work_alloc(&sim->p, &mfw);
 
 	if (sim->p.period_uneqlt > 0) {
-		const int E = 1 + (F - 1) / N_MUL;
+		const int E = 1 + (F_max - 1) / N_MUL;
 
 		Gredu = my_calloc(N*E*N*E * sizeof(num));
 		tauu = my_calloc(N*E * sizeof(num));
 		Qu = my_calloc(4*N*N * sizeof(num));
 
 		Gredd = my_calloc(N*E*N*E * sizeof(num));
-		taud = my_calloc(N*E * sizeof(num));
-		Qd = my_calloc(4*N*N * sizeof(num));
+		taud = !ph ? my_calloc(N*E * sizeof(num)) : NULL;
+		Qd = !ph ? my_calloc(4*N*N * sizeof(num)) : NULL;
 
-// 		Gu0t = my_calloc(N*N*L * sizeof(num));
-// 		Gutt = my_calloc(N*N*L * sizeof(num));
-// 		Gut0 = my_calloc(N*N*L * sizeof(num));
-// 		Gd0t = my_calloc(N*N*L * sizeof(num));
-// 		Gdtt = my_calloc(N*N*L * sizeof(num));
-// 		Gdt0 = my_calloc(N*N*L * sizeof(num));
-		ueGu = my_calloc(N*N*L*L * sizeof(num));
-		ueGd = my_calloc(N*N*L*L * sizeof(num));
-		if (ueGu == NULL || ueGd == NULL) return -1;
+		if (ue_full)
+			ue_full_work_alloc(&sim->p, omp_get_max_threads(), &uew);
+		else {
+			Gu0t = my_calloc(N*N*L * sizeof(num));
+			Gutt = my_calloc(N*N*L * sizeof(num));
+			Gut0 = my_calloc(N*N*L * sizeof(num));
+			Gd0t = my_calloc(N*N*L * sizeof(num));
+			Gdtt = my_calloc(N*N*L * sizeof(num));
+			Gdt0 = my_calloc(N*N*L * sizeof(num));
+		}
 	}
 
 	// lapack work arrays
 	int lwork = get_lwork_eq_g(N);
 	if (sim->p.period_uneqlt > 0) {
-		const int E = 1 + (F - 1) / N_MUL;
+		const int E = 1 + (F_max - 1) / N_MUL;
 		const int lwork_ue = get_lwork_ue_g(N, E);
 		if (lwork_ue > lwork) lwork = lwork_ue;
 	}
 	num *const restrict worku = my_calloc(lwork * sizeof(num));
 	num *const restrict workd = my_calloc(lwork * sizeof(num));
 
+	// global moves and replica swaps: the proposed g and products
+	const int global = sim->p.global_period > 0;
+	const int replica = sim->p.replica_period > 0;
+	const int propose = global || replica;
+	num *const restrict gtu = propose ? my_calloc(N*N * sizeof(num)) : NULL;
+	num *const restrict gtd = (propose && !ph) ? my_calloc(N*N * sizeof(num)) : NULL;
+	num *const restrict Cbu = propose ? my_calloc(N*N*F_max * sizeof(num)) : NULL;
+	num *const restrict Cbd = (propose && !ph) ? my_calloc(N*N*F_max * sizeof(num)) : NULL;
+	int *const restrict gsites = global ? my_calloc(N * sizeof(int)) : NULL;
+
 	{
 	num phaseu, phased;
 	#pragma omp parallel sections
 	{
 	#pragma omp section
 	{
-	if (sim->p.period_uneqlt > 0)
-		for (int l = 0; l < L; l++)
-			calciBu(iBu + N*N*l, l);
-	for (int l = 0; l < L; l++)
-		calcBu(Bu + N*N*l, l);
 	for (int f = 0; f < F; f++)
-		mul_seq(N, L, f*n_matmul, ((f + 1)*n_matmul) % L, 1.0,
-		        Bu, Cu + N*N*f, N, tmpNN1u);
-	phaseu = calc_eq_g(0, N, F, N_MUL, Cu, gu, tmpNN1u, tmpNN2u,
-	                  tmpN1u, tmpN2u, tmpN3u, pvtu, worku, lwork);
+		calcCu(Cu + N*N*f, f);
+	if (ue) {
+		matmul(hPu, inv_exp_halfKu, exp_Ku);
+		matmul(hQu, inv_exp_Ku, exp_halfKu);
+		for (int l = 0; l < L; l++)
+			calchBu(l);
+	}
+	if (sim->p.udt_stack) {
+		udt_stack_build(N, F, stab, Cu, Ru, Lu, tmpNN1u,
+		                tmpN1u, pvtu, worku, lwork);
+		phaseu = calc_eq_g_udt(N, Ru, Lu, gu, tmpNN1u,
+		                      tmpN1u, tmpN2u, pvtu, worku, lwork, &ldu);
+	} else
+		phaseu = calc_eq_g(0, N, F, N_MUL, stab, Cu, gu, tmpNN1u, tmpNN2u,
+		                  tmpN1u, tmpN2u, tmpN3u, pvtu, worku, lwork, &ldu);
 	}
 	#pragma omp section
-	{
-	if (sim->p.period_uneqlt > 0)
-		for (int l = 0; l < L; l++)
-			calciBd(iBd + N*N*l, l);
-	for (int l = 0; l < L; l++)
-		calcBd(Bd + N*N*l, l);
+	if (!ph) {
 	for (int f = 0; f < F; f++)
-		mul_seq(N, L, f*n_matmul, ((f + 1)*n_matmul) % L, 1.0,
-		        Bd, Cd + N*N*f, N, tmpNN1d);
-	phased = calc_eq_g(0, N, F, N_MUL, Cd, gd, tmpNN1d, tmpNN2d,
-	                  tmpN1d, tmpN2d, tmpN3d, pvtd, workd, lwork);
+		calcCd(Cd + N*N*f, f);
+	if (ue) {
+		matmul(hPd, inv_exp_halfKd, exp_Kd);
+		matmul(hQd, inv_exp_Kd, exp_halfKd);
+		for (int l = 0; l < L; l++)
+			calchBd(l);
+	}
+	if (sim->p.udt_stack) {
+		udt_stack_build(N, F, stab, Cd, Rd, Ld, tmpNN1d,
+		                tmpN1d, pvtd, workd, lwork);
+		phased = calc_eq_g_udt(N, Rd, Ld, gd, tmpNN1d,
+		                      tmpN1d, tmpN2d, pvtd, workd, lwork, &ldd);
+	} else
+		phased = calc_eq_g(0, N, F, N_MUL, stab, Cd, gd, tmpNN1d, tmpNN2d,
+		                  tmpN1d, tmpN2d, tmpN3d, pvtd, workd, lwork, &ldd);
 	}
 	}
-	phase = phaseu*phased;
+	// the signs of det M_u and det M_d agree
+	phase = ph ? phaseu*phaseu : phaseu*phased;
 	}
 
 	for (; sim->s.sweep < sim->p.n_sweep; sim->s.sweep++) {
-		const int sig = sig_check_state(sim->s.sweep, sim->p.n_sweep_warm, sim->p.n_sweep);
+		// with several walkers, only the first one reports progress,
+		// and the file is only written once all of them have stopped.
+		// replicas stop together, since they meet at the exchanges
+		int sig;
+		if (replica) {
+			#pragma omp single copyprivate(sig)
+			sig = sig_check_state(sim->s.sweep, sim->p.n_sweep_warm, sim->p.n_sweep);
+		} else
+			sig = (sim->id == 0) ?
+			      sig_check_state(sim->s.sweep, sim->p.n_sweep_warm, sim->p.n_sweep) :
+			      sig_stopped();
 		if (sig == 1) // stop flag
 			break;
-		else if (sig == 2) { // progress flag
+		else if (sig == 2 && sim->n_walker == 1) { // progress flag
 			const int status = sim_data_save(sim);
 			if (status < 0)
 				fprintf(stderr, "save_file() failed: %d\n", status);
 		}
 
-		for (int l = 0; l < L; l++) {
+		// with udt_stack, alternate between sweeping up and down in
+		// imaginary time, so that the stacks can be extended one group
+		// of slices at a time
+		const int up = !sim->p.udt_stack || sim->s.sweep % 2 == 0;
+		// one team for all slices of the sweep. thread 0 also runs the
+		// serial parts, while the other thread waits at sb
+		num phaseu, phased;
+		double erru = 0.0, errd = 0.0;
+		int n_flip, hB_full;
+		#pragma omp parallel num_threads(n_spin) proc_bind(close)
+		{
+		#pragma omp single
+		spin_barrier_init(&sb, omp_get_num_threads());
+		const int tid = omp_get_thread_num();
+		const int do_u = (tid == 0);
+		const int do_d = !ph && (tid == 1 || sb.n == 1);
+		for (int ll = 0; ll < L; ll++) {
+			const int l = up ? ll : L - 1 - ll;
+			const int f = l / n_matmul;
+			const int t = up ? l + 1 : l; // time slice of g after this step
+			const int recalc = (t % n_matmul == 0);
+			const int meas = (sim->s.sweep >= sim->p.n_sweep_warm) &&
+			                 (sim->p.period_eqlt > 0) &&
+			                 t % sim->p.period_eqlt == 0;
+
+			if (!up && do_u) {
+				profile_begin(wrap);
+				bwrapu(gu, l);
+				profile_end(wrap);
+			}
+			if (!up && do_d) {
+				profile_begin(wrap);
+				bwrapd(gd, l);
+				profile_end(wrap);
+			}
+
 			profile_begin(updates);
-			shuffle(rng, N, site_order);
-			update_delayed(N, n_delay, del, site_order,
-			               rng, hs + N*l, gu, gd, &phase,
+			if (tid == 0) {
+				shuffle(rng, n_int, site_order);
+				rand_doub_n(rng, n_rand_u, rand_u);
+			}
+			spin_barrier_wait(&sb);
+			const int nf = submat ?
+			        update_submat(N, q, del, n_int, int_sites,
+			               site_order, rand_u, hs + n_int*l, gu, ph ? NULL : gd, &phase, flip,
+			               tmpNN1u, tmpNN2u, tmpN1u, tmpN2u, tmpN3u, LUu,
+			               tmpNN1d, tmpNN2d, tmpN1d, tmpN2d, tmpN3d, LUd,
+			               submat_r, &sb) :
+			        n_inner ?
+			        update_delayed_rec(N, n_delay, n_inner, del, n_int, int_sites,
+			               site_order, rand_u, hs + n_int*l, gu, ph ? NULL : gd, &phase, flip,
+			               tmpNN1u, tmpNN2u, tmpN1u, lau, lwu,
+			               tmpNN1d, tmpNN2d, tmpN1d, lad, lwd, &sb) :
+			        update_delayed(N, n_delay, del, n_int, int_sites,
+			               site_order, rand_u, hs + n_int*l, gu, ph ? NULL : gd, &phase, flip,
 			               tmpNN1u, tmpNN2u, tmpN1u,
-			               tmpNN1d, tmpNN2d, tmpN1d);
-			profile_end(updates);
+			               tmpNN1d, tmpNN2d, tmpN1d, &sb);
+			if (tid == 0) {
+				profile_end(updates);
+				n_flip = nf;
+				#ifdef CHECK_G_ACC
+				calcBu(Bu + N*N*l, l);
+				calcBd(Bd + N*N*l, l);
+				#endif
+				hB_full = 0;
+				if (ue) {
+					hB_n_flip[l] += n_flip;
+					hB_full = hB_n_flip[l] >= N;
+					if (hB_full) hB_n_flip[l] = 0;
+				}
+			}
+			spin_barrier_wait(&sb);
 
-			const int f = l / n_matmul;
-			const int recalc = ((l + 1) % n_matmul == 0);
-			num phaseu, phased;
-			#pragma omp parallel sections
-			{
-			#pragma omp section
-			{
-			num *const restrict Bul = Bu + N*N*l;
-			num *const restrict iBul = iBu + N*N*l;
+			if (do_u) {
 			num *const restrict Cuf = Cu + N*N*f;
-			profile_begin(calcb);
-			calcBu(Bul, l);
-			if (!recalc || sim->p.period_uneqlt > 0)
-				calciBu(iBul, l);
-			profile_end(calcb);
+			if (ue) {
+				profile_begin(calcb);
+				if (hB_full) {
+					calchBu(l);
+				} else
+					half_b_flip(N, n_flip, flip, 0, int_sites, hs + n_int*l,
+					            exp_lambda, hPu, exp_halfKu,
+					            inv_exp_halfKu, hQu, hBu + N*N*l,
+					            hiBu + N*N*l, tmpNN1u, tmpNN2u);
+				profile_end(calcb);
+			}
 			if (recalc) {
 				profile_begin(multb);
-				mul_seq(N, L, f*n_matmul, ((f + 1)*n_matmul) % L,
-				        1.0, Bu, Cuf, N, tmpNN1u);
+				calcCu(Cuf, f);
 				profile_end(multb);
 				profile_begin(recalc);
-				#ifdef CHECK_G_WRP
-				if (sim->p.period_uneqlt == 0)
-					calciBu(iBu + N*N*l, l);
-				matmul(tmpNN1u, gu, iBu + N*N*l);
-				matmul(guwrp, Bu + N*N*l, tmpNN1u);
-				#endif
+				if (check_wrp) {
+					my_copy(guwrp, gu, N*N);
+					if (up)
+						wrapu(guwrp, l);
+				}
 				#ifdef CHECK_G_ACC
-				calc_eq_g((l + 1) % L, N, L, 1, Bu, guacc,
+				calc_eq_g(t % L, N, L, 1, stab, Bu, guacc,
 				          tmpNN1u, tmpNN2u, tmpN1u, tmpN2u,
-				          tmpN3u, pvtu, worku, lwork);
+				          tmpN3u, pvtu, worku, lwork, NULL);
 				#endif
-				phaseu = calc_eq_g((f + 1) % F, N, F, N_MUL, Cu, gu,
-				                  tmpNN1u, tmpNN2u, tmpN1u, tmpN2u,
-				                  tmpN3u, pvtu, worku, lwork);
+				if (sim->p.udt_stack && up) {
+					udt_push(N, stab, "N", Cuf, Ru + UDT_SIZE(N)*f,
+					         Ru + UDT_SIZE(N)*(f + 1), tmpNN1u,
+					         tmpN1u, pvtu, worku, lwork);
+					phaseu = calc_eq_g_udt(N, Ru + UDT_SIZE(N)*(f + 1),
+					                       Lu + UDT_SIZE(N)*(f + 1), gu,
+					                       tmpNN1u, tmpN1u, tmpN2u,
+					                       pvtu, worku, lwork, &ldu);
+				} else if (sim->p.udt_stack) {
+					udt_push(N, stab, "C", Cuf, Lu + UDT_SIZE(N)*(f + 1),
+					         Lu + UDT_SIZE(N)*f, tmpNN1u,
+					         tmpN1u, pvtu, worku, lwork);
+					phaseu = calc_eq_g_udt(N, Ru + UDT_SIZE(N)*f,
+					                       Lu + UDT_SIZE(N)*f, gu,
+					                       tmpNN1u, tmpN1u, tmpN2u,
+					                       pvtu, worku, lwork, &ldu);
+				} else
+					phaseu = calc_eq_g((f + 1) % F, N, F, N_MUL, stab, Cu, gu,
+					                  tmpNN1u, tmpNN2u, tmpN1u, tmpN2u,
+					                  tmpN3u, pvtu, worku, lwork, &ldu);
+				if (check_wrp)
+					erru = max_diff(N*N, gu, guwrp);
 				profile_end(recalc);
-			} else {
+			} else if (up) {
 				profile_begin(wrap);
-				matmul(tmpNN1u, gu, iBul);
-				matmul(gu, Bul, tmpNN1u);
+				wrapu(gu, l);
 				profile_end(wrap);
 			}
+			if (meas) {
+				profile_begin(half_wrap);
+				half_wrapu(tmpNN2u, gu);
+				profile_end(half_wrap);
 			}
-			#pragma omp section
-			{
-			num *const restrict Bdl = Bd + N*N*l;
-			num *const restrict iBdl = iBd + N*N*l;
+			}
+			if (do_d) {
 			num *const restrict Cdf = Cd + N*N*f;
-			profile_begin(calcb);
-			calcBd(Bdl, l);
-			if (!recalc || sim->p.period_uneqlt > 0)
-				calciBd(iBdl, l);
-			profile_end(calcb);
+			if (ue) {
+				profile_begin(calcb);
+				if (hB_full) {
+					calchBd(l);
+				} else
+					half_b_flip(N, n_flip, flip, 1, int_sites, hs + n_int*l,
+					            exp_lambda, hPd, exp_halfKd,
+					            inv_exp_halfKd, hQd, hBd + N*N*l,
+					            hiBd + N*N*l, tmpNN1d, tmpNN2d);
+				profile_end(calcb);
+			}
 			if (recalc) {
 				profile_begin(multb);
-				mul_seq(N, L, f*n_matmul, ((f + 1)*n_matmul) % L,
-				        1.0, Bd, Cdf, N, tmpNN1d);
+				calcCd(Cdf, f);
 				profile_end(multb);
 				profile_begin(recalc);
-				#ifdef CHECK_G_WRP
-				if (sim->p.period_uneqlt == 0)
-					calciBd(iBd + N*N*l, l);
-				matmul(tmpNN1d, gd, iBd + N*N*l);
-				matmul(gdwrp, Bd + N*N*l, tmpNN1d);
-				#endif
+				if (check_wrp) {
+					my_copy(gdwrp, gd, N*N);
+					if (up)
+						wrapd(gdwrp, l);
+				}
 				#ifdef CHECK_G_ACC
-				calc_eq_g((l + 1) % L, N, L, 1, Bd, gdacc,
+				calc_eq_g(t % L, N, L, 1, stab, Bd, gdacc,
 				          tmpNN1d, tmpNN2d, tmpN1d, tmpN2d,
-				          tmpN3d, pvtd, workd, lwork);
+				          tmpN3d, pvtd, workd, lwork, NULL);
 				#endif
-				phased = calc_eq_g((f + 1) % F, N, F, N_MUL, Cd, gd,
-				                  tmpNN1d, tmpNN2d, tmpN1d, tmpN2d,
-				                  tmpN3d, pvtd, workd, lwork);
+				if (sim->p.udt_stack && up) {
+					udt_push(N, stab, "N", Cdf, Rd + UDT_SIZE(N)*f,
+					         Rd + UDT_SIZE(N)*(f + 1), tmpNN1d,
+					         tmpN1d, pvtd, workd, lwork);
+					phased = calc_eq_g_udt(N, Rd + UDT_SIZE(N)*(f + 1),
+					                       Ld + UDT_SIZE(N)*(f + 1), gd,
+					                       tmpNN1d, tmpN1d, tmpN2d,
+					                       pvtd, workd, lwork, &ldd);
+				} else if (sim->p.udt_stack) {
+					udt_push(N, stab, "C", Cdf, Ld + UDT_SIZE(N)*(f + 1),
+					         Ld + UDT_SIZE(N)*f, tmpNN1d,
+					         tmpN1d, pvtd, workd, lwork);
+					phased = calc_eq_g_udt(N, Rd + UDT_SIZE(N)*f,
+					                       Ld + UDT_SIZE(N)*f, gd,
+					                       tmpNN1d, tmpN1d, tmpN2d,
+					                       pvtd, workd, lwork, &ldd);
+				} else
+					phased = calc_eq_g((f + 1) % F, N, F, N_MUL, stab, Cd, gd,
+					                  tmpNN1d, tmpNN2d, tmpN1d, tmpN2d,
+					                  tmpN3d, pvtd, workd, lwork, &ldd);
+				if (check_wrp)
+					errd = max_diff(N*N, gd, gdwrp);
 				profile_end(recalc);
-			} else {
+			} else if (up) {
 				profile_begin(wrap);
-				matmul(tmpNN1d, gd, iBdl);
-				matmul(gd, Bdl, tmpNN1d);
+				wrapd(gd, l);
 				profile_end(wrap);
 			}
+			if (meas) {
+				profile_begin(half_wrap);
+				half_wrapd(tmpNN2d, gd);
+				profile_end(half_wrap);
 			}
 			}
+			spin_barrier_wait(&sb);
 
+			if (tid == 0) {
+			#ifdef CHECK_G_ACC
+			if (recalc && ph) {
+				// compare the derived gd with the directly computed one
+				calc_eq_g(t % L, N, L, 1, stab, Bd, gdacc,
+				          tmpNN1d, tmpNN2d, tmpN1d, tmpN2d,
+				          tmpN3d, pvtd, workd, lwork, NULL);
+				ph_gd(gd, gu);
+			}
+			#endif
 			#ifdef CHECK_G_WRP
 			if (recalc) {
 				matdiff(N, N, gu, N, guwrp, N);
-				matdiff(N, N, gd, N, gdwrp, N);
+				if (!ph) matdiff(N, N, gd, N, gdwrp, N);
 			}
 			#endif
 			#ifdef CHECK_G_ACC
@@ -335,37 +896,35 @@ static int dqmc(struct sim_data *sim)
 			#if defined(CHECK_G_WRP) && defined(CHECK_G_ACC)
 			if (recalc) {
 				matdiff(N, N, guwrp, N, guacc, N);
-				matdiff(N, N, gdwrp, N, gdacc, N);
+				if (!ph) matdiff(N, N, gdwrp, N, gdacc, N);
 			}
 			#endif
 
-			if (recalc) phase = phaseu*phased;
+			if (recalc) {
+				phase = ph ? phaseu*phaseu : phaseu*phased;
+				if (erru > wrap_err) wrap_err = erru;
+				if (errd > wrap_err) wrap_err = errd;
+				if (wrap_err > sim->wrap_err) sim->wrap_err = wrap_err;
+			}
 
-			if ((sim->s.sweep >= sim->p.n_sweep_warm) &&
-					(sim->p.period_eqlt > 0) &&
-					(l + 1) % sim->p.period_eqlt == 0) {
-				#pragma omp parallel sections
-				{
-				#pragma omp section
-				{
-				profile_begin(half_wrap);
-				matmul(tmpNN1u, gu, exp_halfKu);
-				matmul(tmpNN2u, inv_exp_halfKu, tmpNN1u);
-				profile_end(half_wrap);
-				}
-				#pragma omp section
-				{
-				profile_begin(half_wrap);
-				matmul(tmpNN1d, gd, exp_halfKd);
-				matmul(tmpNN2d, inv_exp_halfKd, tmpNN1d);
-				profile_end(half_wrap);
-				}
+			if (meas) {
+				if (ph) {
+					profile_begin(half_wrap);
+					ph_gd(tmpNN2d, tmpNN2u);
+					profile_end(half_wrap);
 				}
 
 				profile_begin(meas_eq);
-				measure_eqlt(&sim->p, phase, tmpNN2u, tmpNN2d, &sim->m_eq);
+				measure_eqlt(&sim->p, phase, tmpNN2u, tmpNN2d, &mfw, &sim->m_eq);
 				profile_end(meas_eq);
 			}
+			}
+			// meanwhile the other thread may go on to the next bwrapd,
+			// which only touches gd and tmpNN1d. the checks above read gd
+			#if defined(CHECK_G_WRP) || defined(CHECK_G_ACC)
+			spin_barrier_wait(&sb);
+			#endif
+		}
 		}
 
 		if ((sim->s.sweep >= sim->p.n_sweep_warm) && (sim->p.period_uneqlt > 0) &&
@@ -375,34 +934,16 @@ static int dqmc(struct sim_data *sim)
 			#pragma omp section
 			{
 			profile_begin(half_wrap);
-			for (int l = 0; l < L; l++) {
-				matmul(tmpNN1u, Bu + N*N*l, exp_halfKu);
-				matmul(hBu + N*N*l, inv_exp_halfKu, tmpNN1u);
-			}
-			for (int l = 0; l < L; l++) {
-				matmul(tmpNN1u, iBu + N*N*l, exp_halfKu);
-				matmul(hiBu + N*N*l, inv_exp_halfKu, tmpNN1u);
-			}
 			for (int l = 0; l < F; l++) {
-				matmul(tmpNN1u, Cu + N*N*l, exp_halfKu);
-				matmul(hCu + N*N*l, inv_exp_halfKu, tmpNN1u);
+				half_wrapu(hCu + N*N*l, Cu + N*N*l);
 			}
 			profile_end(half_wrap);
 			}
 			#pragma omp section
-			{
+			if (!ph) {
 			profile_begin(half_wrap);
-			for (int l = 0; l < L; l++) {
-				matmul(tmpNN1d, Bd + N*N*l, exp_halfKd);
-				matmul(hBd + N*N*l, inv_exp_halfKd, tmpNN1d);
-			}
-			for (int l = 0; l < L; l++) {
-				matmul(tmpNN1d, iBd + N*N*l, exp_halfKd);
-				matmul(hiBd + N*N*l, inv_exp_halfKd, tmpNN1d);
-			}
 			for (int l = 0; l < F; l++) {
-				matmul(tmpNN1d, Cd + N*N*l, exp_halfKd);
-				matmul(hCd + N*N*l, inv_exp_halfKd, tmpNN1d);
+				half_wrapd(hCd + N*N*l, Cd + N*N*l);
 			}
 			profile_end(half_wrap);
 			}
@@ -411,15 +952,51 @@ static int dqmc(struct sim_data *sim)
 			#pragma omp parallel sections
 			{
 			#pragma omp section
-// 			calc_ue_g(N, L, F, N_MUL, Bu, iBu, Cu, Gu0t, Gutt, Gut0,
-// 			          Gredu, tauu, Qu, worku, lwork);
-			calc_ue_g_full(N, L, F, N_MUL, hBu, hiBu, hCu, ueGu,
-			          Gredu, tauu, Qu, worku, lwork);
+			{
+			if (ue_full)
+				calc_ue_g_red(N, F, N_MUL, hCu,
+				          Gredu, tauu, Qu, worku, lwork);
+			else
+				calc_ue_g(N, L, F, N_MUL, hBu, hiBu, hCu,
+				          Gu0t, Gutt, Gut0,
+				          Gredu, tauu, Qu, worku, lwork);
+			}
 			#pragma omp section
-// 			calc_ue_g(N, L, F, N_MUL, Bd, iBd, Cd, Gd0t, Gdtt, Gdt0,
-// 			          Gredd, taud, Qd, workd, lwork);
-			calc_ue_g_full(N, L, F, N_MUL, hBd, hiBd, hCd, ueGd,
-			          Gredd, taud, Qd, workd, lwork);
+			if (!ph) {
+			if (ue_full)
+				calc_ue_g_red(N, F, N_MUL, hCd,
+				          Gredd, taud, Qd, workd, lwork);
+			else
+				calc_ue_g(N, L, F, N_MUL, hBd, hiBd, hCd,
+				          Gd0t, Gdtt, Gdt0,
+				          Gredd, taud, Qd, workd, lwork);
+			}
+			}
+
+			if (ph) {
+				// G_d(t,t) = I - S G_u(t,t)^T S, G_d(t,0) = d_t0 I - S G_u(0,t)^T S,
+				// and likewise for G_d(0,t). the full path uses
+				// B_d = S iB_u^T S and the reduced matrix
+				profile_begin(half_wrap);
+				if (ue_full) {
+					const int E = 1 + (F - 1) / N_MUL;
+					for (int l = 0; l < L; l++) {
+						ph_transpose(N, N, ph_sign, 0.0, 1.0,
+						             hiBu + N*N*l, hBd + N*N*l);
+						ph_transpose(N, N, ph_sign, 0.0, 1.0,
+						             hBu + N*N*l, hiBd + N*N*l);
+					}
+					ph_transpose(N, N*E, ph_sign, 1.0, -1.0, Gredu, Gredd);
+				} else
+					for (int l = 0; l < L; l++) {
+						ph_transpose(N, N, ph_sign, 1.0, -1.0,
+						             Gutt + N*N*l, Gdtt + N*N*l);
+						ph_transpose(N, N, ph_sign, l == 0, -1.0,
+						             Gu0t + N*N*l, Gdt0 + N*N*l);
+						ph_transpose(N, N, ph_sign, l == 0, -1.0,
+						             Gut0 + N*N*l, Gd0t + N*N*l);
+					}
+				profile_end(half_wrap);
 			}
 
 // 			#ifdef CHECK_G_UE
@@ -432,10 +1009,19 @@ static int dqmc(struct sim_data *sim)
 // 			#endif
 
 			profile_begin(meas_uneq);
-// 			measure_uneqlt(&sim->p, phase,
-// 			               Gu0t, Gutt, Gut0, Gd0t, Gdtt, Gdt0,
-// 			               &sim->m_ue);
-			measure_uneqlt_full(&sim->p, phase, ueGu, ueGd, &sim->m_ue);
+			if (ue_full) {
+				// blocks of G(k, l) are expanded from Gred inside the
+				// measurement, never storing the full N*L x N*L matrix
+				const struct ue_g ueu = {N, L, 1 + (F - 1)/N_MUL,
+				                         (L/F)*N_MUL, hBu, hiBu, Gredu};
+				const struct ue_g ued = {N, L, 1 + (F - 1)/N_MUL,
+				                         (L/F)*N_MUL, hBd, hiBd, Gredd};
+				measure_uneqlt_full(&sim->p, phase, &ueu, &ued,
+				                    &uew, &mfw, rng, &sim->m_ue);
+			} else
+				measure_uneqlt(&sim->p, phase,
+				               Gu0t, Gutt, Gut0, Gd0t, Gdtt, Gdt0,
+				               &mfw, &sim->m_ue);
 			profile_end(meas_uneq);
 			// #pragma omp parallel sections
 			// {
@@ -460,27 +1046,285 @@ static int dqmc(struct sim_data *sim)
 			// measure_uneqlt(&sim->p, sign, ueGu, ueGd, &sim->m_ue);
 			// profile_end(meas_uneq);
 		}
+
+		if (adapt) {
+			// step to the next smaller divisor of L if the tolerance
+			// was exceeded, or to the next larger one if there is
+			// plenty of room. g is at time 0 here, so only the
+			// products (and stacks) need to be regrouped. with
+			// uneqlt measurements, n_matmul stays at or below the
+			// input value, since the expansion of the unequal-time
+			// G multiplies up to n_matmul B's without stabilization
+			int n = n_matmul;
+			if (wrap_err > sim->p.wrap_tol && n > 1)
+				do n--; while (L % n != 0);
+			else if (wrap_err < 0.1*sim->p.wrap_tol && n < n_matmul_max)
+				do n++; while (L % n != 0);
+			wrap_err = 0.0;
+			if (n != n_matmul) {
+				n_matmul = n;
+				F = L / n_matmul;
+				#pragma omp parallel sections
+				{
+				#pragma omp section
+				{
+				profile_begin(multb);
+				for (int f = 0; f < F; f++)
+					calcCu(Cu + N*N*f, f);
+				profile_end(multb);
+				if (sim->p.udt_stack) {
+					profile_begin(recalc);
+					udt_stack_build(N, F, stab, Cu, Ru, Lu, tmpNN1u,
+					                tmpN1u, pvtu, worku, lwork);
+					profile_end(recalc);
+				}
+				}
+				#pragma omp section
+				if (!ph) {
+				profile_begin(multb);
+				for (int f = 0; f < F; f++)
+					calcCd(Cd + N*N*f, f);
+				profile_end(multb);
+				if (sim->p.udt_stack) {
+					profile_begin(recalc);
+					udt_stack_build(N, F, stab, Cd, Rd, Ld, tmpNN1d,
+					                tmpN1d, pvtd, workd, lwork);
+					profile_end(recalc);
+				}
+				}
+				}
+			}
+		}
+
+		// moves changing the fields of all slices propose g and the
+		// products in gt and Cb. once one is accepted, the stacks and hB
+		// are rebuilt below
+		int rebuild = 0;
+
+		// global move: flip one site (with global_cluster, also its
+		// bonded interacting neighbours) in every slice. g is at time 0
+		// here, and the weight ratio is taken from
+		// log|det(I + B_L-1...B_0)| of a full recalculation for the old
+		// and the new fields. gsites holds positions in int_sites
+		if (global && n_int > 0 &&
+		    (sim->s.sweep + 1) % sim->p.global_period == 0) {
+			profile_begin(global);
+			const int num_b = sim->p.num_b;
+			const int m0 = (rand_uint(rng) >> 3) % n_int;
+			const int i0 = int_sites[m0];
+			int n_gs = 0;
+			gsites[n_gs++] = m0;
+			if (sim->p.global_cluster)
+				for (int b = 0; b < num_b; b++) {
+					int j;
+					if (sim->p.bonds[b] == i0)
+						j = sim->p.bonds[b + num_b];
+					else if (sim->p.bonds[b + num_b] == i0)
+						j = sim->p.bonds[b];
+					else
+						continue;
+					const int mj = int_idx[j];
+					if (mj < 0) continue;
+					int k = 0;
+					while (k < n_gs && gsites[k] != mj) k++;
+					if (k == n_gs) gsites[n_gs++] = mj;
+				}
+
+			double ldu1, ldd1;
+			num phaseu, phased;
+			const double ldd0 = ph ? ldu - ph_log_v(N, L, n_int, int_sites, hs, exp_lambda) : ldd;
+			for (int l = 0; l < L; l++)
+				for (int k = 0; k < n_gs; k++)
+					hs[gsites[k] + n_int*l] = !hs[gsites[k] + n_int*l];
+
+			#pragma omp parallel sections
+			{
+			#pragma omp section
+			{
+			for (int f = 0; f < F; f++)
+				calcCu(Cbu + N*N*f, f);
+			phaseu = calc_eq_g(0, N, F, N_MUL, stab, Cbu, gtu, tmpNN1u, tmpNN2u,
+			                   tmpN1u, tmpN2u, tmpN3u, pvtu, worku, lwork, &ldu1);
+			}
+			#pragma omp section
+			if (!ph) {
+			for (int f = 0; f < F; f++)
+				calcCd(Cbd + N*N*f, f);
+			phased = calc_eq_g(0, N, F, N_MUL, stab, Cbd, gtd, tmpNN1d, tmpNN2d,
+			                   tmpN1d, tmpN2d, tmpN3d, pvtd, workd, lwork, &ldd1);
+			}
+			}
+			if (ph) {
+				ldd1 = ldu1 - ph_log_v(N, L, n_int, int_sites, hs, exp_lambda);
+				phased = phaseu;
+			}
+
+			sim->s.n_global++;
+			if (rand_doub(rng) < exp(ldu1 + ldd1 - ldu - ldd0)) {
+				sim->s.n_global_acc++;
+				ldu = ldu1;
+				ldd = ldd1;
+				my_copy(gu, gtu, N*N);
+				my_copy(Cu, Cbu, N*N*F);
+				if (!ph) {
+					my_copy(gd, gtd, N*N);
+					my_copy(Cd, Cbd, N*N*F);
+				}
+				phase = phaseu*phased;
+				rebuild = 1;
+			} else {
+				for (int l = 0; l < L; l++)
+					for (int k = 0; k < n_gs; k++)
+						hs[gsites[k] + n_int*l] = !hs[gsites[k] + n_int*l];
+			}
+			profile_end(global);
+		}
+
+		// replica exchange: pairs (0,1), (2,3), ... on even exchange
+		// steps and (1,2), (3,4), ... on odd ones. each replica of a pair
+		// computes the weight of its partner's fields with its own
+		// parameters, then the lower one decides and swaps the fields.
+		// the barriers are those of the team of walkers
+		if (replica && (sim->s.sweep + 1) % sim->p.replica_period == 0) {
+			profile_begin(exchange);
+			const int step = (sim->s.sweep + 1) / sim->p.replica_period;
+			struct sim_data *const partner =
+				((sim->id + step) % 2 == 0) ? sim->next : sim->prev;
+			num phaseu = 1.0, phased = 1.0;
+			double ldu1 = 0.0, ldd1 = 0.0;
+			const double ldd0 = ph ? ldu - ph_log_v(N, L, n_int, int_sites, hs, exp_lambda) : ldd;
+			#pragma omp barrier
+			if (partner != NULL) {
+				// calcCu and calcCd below read the partner's fields
+				const int *const restrict hs = partner->s.hs;
+				#pragma omp parallel sections
+				{
+				#pragma omp section
+				{
+				for (int f = 0; f < F; f++)
+					calcCu(Cbu + N*N*f, f);
+				phaseu = calc_eq_g(0, N, F, N_MUL, stab, Cbu, gtu, tmpNN1u, tmpNN2u,
+				                   tmpN1u, tmpN2u, tmpN3u, pvtu, worku, lwork, &ldu1);
+				}
+				#pragma omp section
+				if (!ph) {
+				for (int f = 0; f < F; f++)
+					calcCd(Cbd + N*N*f, f);
+				phased = calc_eq_g(0, N, F, N_MUL, stab, Cbd, gtd, tmpNN1d, tmpNN2d,
+				                   tmpN1d, tmpN2d, tmpN3d, pvtd, workd, lwork, &ldd1);
+				}
+				}
+				if (ph) {
+					ldd1 = ldu1 - ph_log_v(N, L, n_int, int_sites, hs, exp_lambda);
+					phased = phaseu;
+				}
+				sim->lw_self = ldu + ldd0;
+				sim->lw_swap = ldu1 + ldd1;
+			}
+			#pragma omp barrier
+			if (partner != NULL && partner == sim->next) {
+				sim->s.n_swap++;
+				sim->swap = rand_doub(rng) < exp(sim->lw_swap + partner->lw_swap
+				                                 - sim->lw_self - partner->lw_self);
+				if (sim->swap) {
+					sim->s.n_swap_acc++;
+					for (int i = 0; i < n_int*L; i++) {
+						const int h = hs[i];
+						hs[i] = partner->s.hs[i];
+						partner->s.hs[i] = h;
+					}
+				}
+			}
+			#pragma omp barrier
+			if (partner != NULL &&
+			    (partner == sim->next ? sim->swap : partner->swap)) {
+				ldu = ldu1;
+				ldd = ldd1;
+				my_copy(gu, gtu, N*N);
+				my_copy(Cu, Cbu, N*N*F);
+				if (!ph) {
+					my_copy(gd, gtd, N*N);
+					my_copy(Cd, Cbd, N*N*F);
+				}
+				phase = phaseu*phased;
+				rebuild = 1;
+			}
+			profile_end(exchange);
+		}
+
+		if (rebuild) {
+			#pragma omp parallel sections
+			{
+			#pragma omp section
+			{
+			profile_begin(recalc);
+			if (sim->p.udt_stack)
+				udt_stack_build(N, F, stab, Cu, Ru, Lu, tmpNN1u,
+				                tmpN1u, pvtu, worku, lwork);
+			if (ue)
+				for (int l = 0; l < L; l++)
+					calchBu(l);
+			#ifdef CHECK_G_ACC
+			for (int l = 0; l < L; l++)
+				calcBu(Bu + N*N*l, l);
+			#endif
+			profile_end(recalc);
+			}
+			#pragma omp section
+			{
+			profile_begin(recalc);
+			if (sim->p.udt_stack && !ph)
+				udt_stack_build(N, F, stab, Cd, Rd, Ld, tmpNN1d,
+				                tmpN1d, pvtd, workd, lwork);
+			if (ue && !ph)
+				for (int l = 0; l < L; l++)
+					calchBd(l);
+			#ifdef CHECK_G_ACC
+			for (int l = 0; l < L; l++)
+				calcBd(Bd + N*N*l, l);
+			#endif
+			profile_end(recalc);
+			}
+			}
+			if (ue)
+				for (int l = 0; l < L; l++)
+					hB_n_flip[l] = 0;
+		}
 	}
+	sim->p.n_matmul = n_matmul;
+	sim->p.F = F;
 
 
+	my_free(gsites);
+	my_free(Cbd);
+	my_free(Cbu);
+	my_free(gtd);
+	my_free(gtu);
 	my_free(workd);
 	my_free(worku);
 	if (sim->p.period_uneqlt > 0) {
 		my_free(Qd);
 		my_free(taud);
 		my_free(Gredd);
-		my_free(ueGd);
-// 		my_free(Gdt0);
-// 		my_free(Gdtt);
-// 		my_free(Gd0t);
+		my_free(Gdt0);
+		my_free(Gdtt);
+		my_free(Gd0t);
 		my_free(Qu);
 		my_free(tauu);
 		my_free(Gredu);
-		my_free(ueGu);
-// 		my_free(Gut0);
-// 		my_free(Gutt);
-// 		my_free(Gu0t);
+		my_free(Gut0);
+		my_free(Gutt);
+		my_free(Gu0t);
+		if (ue_full) ue_full_work_free(&uew);
 	}
+	meas_fft_work_free(&mfw);
+	my_free(lwd);
+	my_free(lwu);
+	my_free(lad);
+	my_free(lau);
+	my_free(submat_r);
+	my_free(LUd);
+	my_free(LUu);
 	my_free(pvtd);
 	my_free(tmpN3d);
 	my_free(tmpN2d);
@@ -493,18 +1337,35 @@ static int dqmc(struct sim_data *sim)
 	my_free(tmpN1u);
 	my_free(tmpNN2u);
 	my_free(tmpNN1u);
+	my_free(rand_u);
 	my_free(site_order);
 	#ifdef CHECK_G_ACC
+	my_free(Bd);
+	my_free(Bu);
 	my_free(gdacc);
 	my_free(guacc);
 	#endif
-	#ifdef CHECK_G_WRP
 	my_free(gdwrp);
 	my_free(guwrp);
-	#endif
 	my_free(gd);
 	my_free(gu);
 
+	if (fft_K) {
+		fftk_free(&fftkd);
+		fftk_free(&fftku);
+	}
+
+	my_free(Ld);
+	my_free(Rd);
+	my_free(Lu);
+	my_free(Ru);
+
+	my_free(hB_n_flip);
+	my_free(flip);
+	my_free(hQd);
+	my_free(hQu);
+	my_free(hPd);
+	my_free(hPu);
 	my_free(hCd);
 	my_free(hCu);
 	my_free(hiBd);
@@ -514,16 +1375,138 @@ static int dqmc(struct sim_data *sim)
 
 	my_free(Cd);
 	my_free(Cu);
-	my_free(iBd);
-	my_free(iBu);
-	my_free(Bd);
-	my_free(Bu);
 
 	return 0;
 }
 
+// largest deviation from the particle-hole relations used with ph_sym:
+// exp_Kd = S inv_exp_Ku^T S (and for the half step), and
+// exp_lambda[i] exp_lambda[i + N] = 1
+static double ph_check(const struct params *const p)
+{
+	const int N = p->N;
+	const double *const s = p->ph_sign;
+	double max = 0.0;
+	for (int j = 0; j < N; j++)
+		for (int i = 0; i < N; i++) {
+			const double d0 = fabs(p->exp_Kd[i + N*j] -
+			                       s[i]*s[j]*p->inv_exp_Ku[j + N*i]);
+			const double d1 = fabs(p->exp_halfKd[i + N*j] -
+			                       s[i]*s[j]*p->inv_exp_halfKu[j + N*i]);
+			if (d0 > max) max = d0;
+			if (d1 > max) max = d1;
+		}
+	for (int i = 0; i < N; i++) {
+		const double d = fabs(p->exp_lambda[i]*p->exp_lambda[i + N] - 1.0);
+		if (d > max) max = d;
+	}
+	return max;
+}
+
+// tuning mode (dqmc_1 -T): short runs of TUNE_SWEEPS sweeps, each starting
+// from the state in the file. n_matmul is set to the largest divisor of L
+// whose wrap error stays below wrap_tol (TUNE_WRAP_TOL if wrap_tol = 0),
+// then n_delay to the fastest power of two up to N
+#define TUNE_SWEEPS 4
+#define TUNE_WRAP_TOL 1e-6
+
+static int tune_run(struct sim_data *sim, const struct state *s0,
+		const int n_matmul, const int n_delay, tick_t *time)
+{
+	const int n_int = sim->p.n_int, L = sim->p.L;
+	my_copy(sim->s.rng, s0->rng, 17);
+	my_copy(sim->s.hs, s0->hs, n_int*L);
+	sim->s.sweep = s0->sweep;
+	// no measurements: they start at n_sweep_warm
+	sim->p.n_sweep_warm = sim->p.n_sweep = s0->sweep + TUNE_SWEEPS;
+	sim->p.n_matmul = n_matmul;
+	sim->p.F = L / n_matmul;
+	sim->p.n_delay = n_delay;
+	sim->wrap_err = 0.0;
+	const tick_t start = time_wall();
+	const int status = dqmc(sim);
+	*time = time_wall() - start;
+	return (status < 0 || sig_stopped()) ? -1 : 0;
+}
+
+static int dqmc_tune(struct sim_data *sim, FILE *log)
+{
+	const int N = sim->p.N, L = sim->p.L;
+	const struct params p0 = sim->p;
+	struct state s0 = sim->s;
+	s0.hs = my_calloc(sim->p.n_int*L * sizeof(int));
+	my_copy(s0.hs, sim->s.hs, sim->p.n_int*L);
+
+	const double tol = p0.wrap_tol > 0.0 ? p0.wrap_tol : TUNE_WRAP_TOL;
+	sim->p.wrap_tol = 0.0;
+	sim->p.global_period = 0;
+	sim->p.replica_period = 0;
+	sim->check_wrp = 1;
+
+	char host[256] = "unknown";
+	gethostname(host, sizeof(host) - 1);
+	fprintf(log, "tuning on %s, %d sweeps per run, wrap_tol=%.3e\n",
+	        host, TUNE_SWEEPS, tol);
+
+	// n_matmul: from the input value, up while the wrap error stays
+	// within tol or down until it does. with uneqlt measurements, not
+	// above the input value (see the adjustment in dqmc())
+	const int n_matmul_max = p0.period_uneqlt > 0 ? p0.n_matmul : L;
+	int n_matmul = p0.n_matmul;
+	tick_t time;
+	int status = tune_run(sim, &s0, n_matmul, p0.n_delay, &time);
+	fprintf(log, "n_matmul=%d: wrap error %.3e\n", n_matmul, sim->wrap_err);
+	if (!(sim->wrap_err <= tol)) {
+		while (status == 0 && !(sim->wrap_err <= tol) && n_matmul > 1) {
+			do n_matmul--; while (L % n_matmul != 0);
+			status = tune_run(sim, &s0, n_matmul, p0.n_delay, &time);
+			fprintf(log, "n_matmul=%d: wrap error %.3e\n",
+			        n_matmul, sim->wrap_err);
+		}
+	} else
+		for (int n = n_matmul + 1; status == 0 && n <= n_matmul_max; n++) {
+			if (L % n != 0) continue;
+			status = tune_run(sim, &s0, n, p0.n_delay, &time);
+			fprintf(log, "n_matmul=%d: wrap error %.3e\n",
+			        n, sim->wrap_err);
+			if (!(sim->wrap_err <= tol)) break;
+			n_matmul = n;
+		}
+
+	// n_delay: the fastest full run. two-level updates need
+	// n_delay >= n_delay_inner
+	int n_delay = p0.n_delay;
+	tick_t best = -1;
+	for (int nd = 4; status == 0 && nd <= N; nd *= 2) {
+		if (p0.update_method == UPDATE_DELAYED && nd < p0.n_delay_inner)
+			continue;
+		status = tune_run(sim, &s0, n_matmul, nd, &time);
+		fprintf(log, "n_delay=%d: %.3f s\n", nd, time * SEC_PER_TICK);
+		if (best < 0 || time < best) {
+			best = time;
+			n_delay = nd;
+		}
+	}
+
+	sim->p = p0;
+	sim->check_wrp = 0;
+	my_copy(sim->s.rng, s0.rng, 17);
+	my_copy(sim->s.hs, s0.hs, sim->p.n_int*L);
+	sim->s.sweep = s0.sweep;
+	my_free(s0.hs);
+	if (status < 0)
+		return -1;
+
+	fprintf(log, "tuned: n_matmul=%d (was %d), n_delay=%d (was %d)\n",
+	        n_matmul, p0.n_matmul, n_delay, p0.n_delay);
+	sim->p.n_matmul = n_matmul;
+	sim->p.F = L / n_matmul;
+	sim->p.n_delay = n_delay;
+	return 0;
+}
+
 int dqmc_wrapper(const char *sim_file, const char *log_file,
-		const tick_t max_time, const int bench)
+		const tick_t max_time, const int bench, const int tune)
 {
 	const tick_t wall_start = time_wall();
 	profile_clear();
@@ -560,19 +1543,134 @@ int dqmc_wrapper(const char *sim_file, const char *log_file,
 		goto cleanup;
 	}
 
-	// run dqmc
+	// stabilization method
+	static const char *const stab_name[] = {"pivoted QR", "QR", "SVD", "LDR"};
+	if (sim->p.stab < STAB_QRP || sim->p.stab > STAB_LDR) {
+		fprintf(stderr, "unknown stabilization method: %d\n", sim->p.stab);
+		status = -1;
+		goto cleanup;
+	}
+	fprintf(log, "stabilization: %s%s\n", stab_name[sim->p.stab],
+	        sim->p.udt_stack ? ", udt stack" : "");
+	if (sim->p.udt_stack && sim->p.stab == STAB_SVD) {
+		fprintf(log, "udt stack not supported with SVD; disabled\n");
+		sim->p.udt_stack = 0;
+	}
+
+	// update engine
+	if (sim->p.update_method < UPDATE_AUTO || sim->p.update_method > UPDATE_SUBMAT) {
+		fprintf(stderr, "unknown update method: %d\n", sim->p.update_method);
+		status = -1;
+		goto cleanup;
+	}
+	if (sim->p.update_method == UPDATE_AUTO)
+		sim->p.update_method = (sim->p.N >= SUBMAT_MIN_N) ?
+		                       UPDATE_SUBMAT : UPDATE_DELAYED;
+	fprintf(log, "updates: %s, n_delay=%d\n",
+	        sim->p.update_method == UPDATE_SUBMAT ? "submatrix" : "delayed",
+	        sim->p.n_delay);
+	if (sim->p.update_method == UPDATE_DELAYED && sim->p.n_delay_inner > 0)
+		fprintf(log, "two-level delayed updates, n_delay_inner=%d\n",
+		        sim->p.n_delay_inner);
+	if (sim->p.replica_period > 0) {
+		if (sim->p.checkerboard) {
+			fprintf(stderr, "replica exchange not supported with checkerboard\n");
+			status = -1;
+			goto cleanup;
+		}
+		fprintf(log, "replica exchange between %d replicas every %d sweeps\n",
+		        sim->n_walker, sim->p.replica_period);
+	}
+	if (sim->p.global_period > 0)
+		fprintf(log, "global %s moves every %d sweeps\n",
+		        sim->p.global_cluster ? "cluster" : "site",
+		        sim->p.global_period);
+	if (sim->p.ph_sym) {
+		double err = ph_check(&sim->p);
+		for (int k = 1; k < sim->n_walker; k++) {
+			const double e = ph_check(&sim->walker[k - 1].p);
+			if (e > err) err = e;
+		}
+		if (err > 1e-10) {
+			fprintf(log, "particle-hole relations violated (%.3e); ph_sym disabled\n", err);
+			sim->p.ph_sym = 0;
+		} else
+			fprintf(log, "particle-hole symmetric: spin down derived from spin up\n");
+	}
+
+	// tuning mode: pick n_matmul and n_delay and save them instead
+	if (tune) {
+		status = dqmc_tune(sim, log);
+		if (status < 0) {
+			fprintf(stderr, "dqmc_tune() failed or was interrupted\n");
+			goto cleanup;
+		}
+		if (!bench) {
+			fprintf(log, "saving parameters\n");
+			status = sim_data_save_params(sim);
+			if (status < 0) {
+				fprintf(stderr, "save_params() failed: %d\n", status);
+				status = -1;
+			}
+		}
+		goto cleanup;
+	}
+
+	// run dqmc. with several walkers, each one runs its chain on its own
+	// nested team of two threads
 	fprintf(log, "starting dqmc\n");
-	status = dqmc(sim);
+	if (sim->n_walker > 1) {
+		fprintf(log, "%d walkers\n", sim->n_walker);
+		// pick up the adjustments to p above
+		for (int k = 1; k < sim->n_walker; k++) {
+			sim->walker[k - 1].p.udt_stack = sim->p.udt_stack;
+			sim->walker[k - 1].p.update_method = sim->p.update_method;
+			sim->walker[k - 1].p.ph_sym = sim->p.ph_sym;
+		}
+		omp_set_max_active_levels(2);
+		#pragma omp parallel num_threads(sim->n_walker) reduction(min:status)
+		{
+		const int k = omp_get_thread_num();
+		// with ph_sym there is no spin down thread, so each walker runs
+		// on one thread and the spare ones can take more walkers
+		if (sim->p.ph_sym)
+			omp_set_num_threads(1);
+		status = dqmc(k == 0 ? sim : sim->walker + (k - 1));
+		}
+	} else
+		status = dqmc(sim);
 	if (status < 0) {
 		fprintf(stderr, "dqmc() failed to allocate memory\n");
 		status = -1;
 		goto cleanup;
 	}
 	fprintf(log, "%d/%d sweeps completed\n", sim->s.sweep, sim->p.n_sweep);
+	int done = (sim->s.sweep == sim->p.n_sweep);
+	for (int k = 1; k < sim->n_walker; k++) {
+		const struct sim_data *const w = sim->walker + (k - 1);
+		fprintf(log, "walker %d: %d/%d sweeps completed\n",
+		        k, w->s.sweep, w->p.n_sweep);
+		done = done && (w->s.sweep == w->p.n_sweep);
+		sim->s.n_global += w->s.n_global;
+		sim->s.n_global_acc += w->s.n_global_acc;
+	}
+	for (int k = 0; k + 1 < sim->n_walker && sim->p.replica_period > 0; k++) {
+		const struct state *const s = (k == 0) ? &sim->s : &sim->walker[k - 1].s;
+		fprintf(log, "replica swaps %d-%d: accepted %d/%d\n",
+		        k, k + 1, s->n_swap_acc, s->n_swap);
+	}
+	if (sim->p.wrap_tol > 0.0)
+		fprintf(log, "n_matmul adjusted to %d\n", sim->p.n_matmul);
+	if (sim->p.global_period > 0)
+		fprintf(log, "global moves: accepted %d/%d (%.3f)\n",
+		        sim->s.n_global_acc, sim->s.n_global,
+		        sim->s.n_global > 0 ?
+		        (double)sim->s.n_global_acc/sim->s.n_global : 0.0);
 
 	// save to simulation file (if not in benchmarking mode)
 	if (!bench) {
 		fprintf(log, "saving data\n");
+		sim_data_reduce(sim);
 		status = sim_data_save(sim);
 		if (status < 0) {
 			fprintf(stderr, "save_file() failed: %d\n", status);
@@ -583,11 +1681,12 @@ int dqmc_wrapper(const char *sim_file, const char *log_file,
 		fprintf(log, "benchmark mode enabled; not saving data\n");
 	}
 
-	status = (sim->s.sweep == sim->p.n_sweep) ? 0 : 1;
+	status = done ? 0 : 1;
 
 cleanup:
 	sim_data_free(sim);
 	my_free(sim);
+	fftm_free();
 
 	const tick_t wall_time = time_wall() - wall_start;
 	fprintf(log, "wall time: %.3f\n", wall_time * SEC_PER_TICK);
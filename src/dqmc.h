@@ -2,6 +2,7 @@
 
 #include "time_.h"
 
-// returns -1 for failure, 0 for completion, 1 for partial completion
+// returns -1 for failure, 0 for completion, 1 for partial completion.
+// with tune, only picks n_matmul and n_delay and writes them to /params
 int dqmc_wrapper(const char *sim_file, const char *log_file,
-		const tick_t max_time, const int bench);
+		const tick_t max_time, const int bench, const int tune);
@@ -0,0 +1,142 @@
+#include "fftk.h"
+#include <stdio.h>
+#include <complex.h>
+#include <tgmath.h>
+
+#ifdef USE_CPLX
+	#define FFTK_DOMAIN DFTI_COMPLEX
+#else
+	#define FFTK_DOMAIN DFTI_REAL
+#endif
+
+// calls fn, and on a nonzero DFTI status prints it, frees h and returns NULL
+#define dfti_try(fn, ...) do { \
+	const MKL_LONG status = fn(__VA_ARGS__); \
+	if (status != 0) { \
+		fprintf(stderr, #fn "() failed: %ld\n", (long)status); \
+		if (h != NULL) DftiFreeDescriptor(&h); \
+		return NULL; \
+	} \
+} while (0);
+
+// N transforms, each over a vector with site stride s, the vectors
+// spaced dist apart. the momentum side is always contiguous
+static DFTI_DESCRIPTOR_HANDLE make_desc(const struct fftk *f, const int fwd,
+		const MKL_LONG s, const MKL_LONG dist)
+{
+	const int Nx = f->Nx, Ny = f->Ny, N = Nx*Ny;
+	const int kx = f->nk/Ny;
+	DFTI_DESCRIPTOR_HANDLE h = NULL;
+	MKL_LONG len[2] = {Ny, Nx};
+	MKL_LONG rs[3] = {0, Nx*s, s};
+	MKL_LONG ks[3] = {0, kx, 1};
+	dfti_try(DftiCreateDescriptor, &h, DFTI_DOUBLE, FFTK_DOMAIN, 2, len);
+	dfti_try(DftiSetValue, h, DFTI_PLACEMENT, DFTI_NOT_INPLACE);
+#ifndef USE_CPLX
+	dfti_try(DftiSetValue, h, DFTI_CONJUGATE_EVEN_STORAGE, DFTI_COMPLEX_COMPLEX);
+#endif
+	dfti_try(DftiSetValue, h, DFTI_NUMBER_OF_TRANSFORMS, (MKL_LONG)N);
+	dfti_try(DftiSetValue, h, DFTI_INPUT_STRIDES, fwd ? rs : ks);
+	dfti_try(DftiSetValue, h, DFTI_OUTPUT_STRIDES, fwd ? ks : rs);
+	dfti_try(DftiSetValue, h, DFTI_INPUT_DISTANCE, fwd ? dist : (MKL_LONG)f->nk);
+	dfti_try(DftiSetValue, h, DFTI_OUTPUT_DISTANCE, fwd ? (MKL_LONG)f->nk : dist);
+	dfti_try(DftiCommitDescriptor, h);
+	return h;
+}
+
+#undef dfti_try
+
+int fftk_init(struct fftk *f, const int Nx, const int Ny,
+		const num *const restrict exp_K,
+		const num *const restrict inv_exp_K,
+		const num *const restrict exp_halfK,
+		const num *const restrict inv_exp_halfK)
+{
+	const int N = Nx*Ny;
+	const num *const M[4] = {exp_K, inv_exp_K, exp_halfK, inv_exp_halfK};
+
+	// check that M_ij = m(i - j) = m(j - i)
+	for (int w = 0; w < 4; w++) {
+		double max = 0.0;
+		for (int i = 0; i < N; i++)
+			if (fabs(M[w][i]) > max) max = fabs(M[w][i]);
+		for (int j = 0; j < N; j++)
+		for (int i = 0; i < N; i++) {
+			const int dx = (i%Nx - j%Nx + Nx) % Nx;
+			const int dy = (i/Nx - j/Nx + Ny) % Ny;
+			const num m = M[w][dx + Nx*dy];
+			if (fabs(M[w][i + N*j] - m) > 1e-12*max ||
+			    fabs(M[w][j + N*i] - m) > 1e-12*max)
+				return -1;
+		}
+	}
+
+	f->Nx = Nx;
+	f->Ny = Ny;
+#ifdef USE_CPLX
+	f->nk = N;
+#else
+	f->nk = (Nx/2 + 1)*Ny;
+#endif
+	f->ev = my_calloc(4*f->nk * sizeof(double));
+	f->buf = my_calloc(f->nk*N * sizeof(double complex));
+	f->col_fwd = make_desc(f, 1, 1, N);
+	f->col_bwd = make_desc(f, 0, 1, N);
+	f->row_fwd = make_desc(f, 1, N, 1);
+	f->row_bwd = make_desc(f, 0, N, 1);
+	if (f->col_fwd == NULL || f->col_bwd == NULL ||
+	    f->row_fwd == NULL || f->row_bwd == NULL) {
+		fftk_free(f);
+		return -1;
+	}
+
+	// eigenvalues are the transform of m(r) = M_r0, the first column,
+	// which is real since m is even
+	const double complex *const restrict mk = f->buf;
+	for (int w = 0; w < 4; w++) {
+		const MKL_LONG status = DftiComputeForward(f->col_fwd, (void *)M[w], f->buf);
+		if (status != 0) {
+			fprintf(stderr, "DftiComputeForward() failed: %ld\n", (long)status);
+			fftk_free(f);
+			return -1;
+		}
+		for (int k = 0; k < f->nk; k++)
+			f->ev[k + f->nk*w] = creal(mk[k])/N;
+	}
+	return 0;
+}
+
+void fftk_free(struct fftk *f)
+{
+	if (f->row_bwd != NULL) DftiFreeDescriptor(&f->row_bwd);
+	if (f->row_fwd != NULL) DftiFreeDescriptor(&f->row_fwd);
+	if (f->col_bwd != NULL) DftiFreeDescriptor(&f->col_bwd);
+	if (f->col_fwd != NULL) DftiFreeDescriptor(&f->col_fwd);
+	my_free(f->buf);
+	my_free(f->ev);
+}
+
+static void scale(const struct fftk *f, const int which)
+{
+	const int N = f->Nx*f->Ny, nk = f->nk;
+	const double *const restrict ev = f->ev + nk*which;
+	double complex *const restrict buf = f->buf;
+	for (int j = 0; j < N; j++)
+		for (int k = 0; k < nk; k++)
+			buf[k + nk*j] *= ev[k];
+}
+
+void fftk_lmul(const struct fftk *f, const int which, num *const restrict A)
+{
+	DftiComputeForward(f->col_fwd, A, f->buf);
+	scale(f, which);
+	DftiComputeBackward(f->col_bwd, f->buf, A);
+}
+
+// M is symmetric, so rows transform the same way as columns
+void fftk_rmul(const struct fftk *f, const int which, num *const restrict A)
+{
+	DftiComputeForward(f->row_fwd, A, f->buf);
+	scale(f, which);
+	DftiComputeBackward(f->row_bwd, f->buf, A);
+}
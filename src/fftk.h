@@ -0,0 +1,32 @@
+#pragma once
+
+#include <mkl_dfti.h>
+#include "util.h"
+
+// application of exp_K, inv_exp_K, exp_halfK and inv_exp_halfK by 2D FFT,
+// for translation invariant K on a periodic Nx x Ny lattice (site
+// i = ix + Nx*iy). O(N^2 log N) per N x N matrix instead of O(N^3)
+enum { FFTK_K = 0, FFTK_iK = 1, FFTK_hK = 2, FFTK_ihK = 3 };
+
+struct fftk {
+	int Nx, Ny, nk; // nk: number of stored momenta (Nx/2+1 per row if real)
+	DFTI_DESCRIPTOR_HANDLE col_fwd, col_bwd, row_fwd, row_bwd;
+	double *ev; // 4 x nk eigenvalues (divided by N) of the matrices above
+	void *buf;  // nk*N complex numbers
+};
+
+// returns -1 (and sets nothing up) if any of the matrices is not a
+// symmetric function of the site separation, or if the DFTI setup fails
+int fftk_init(struct fftk *f, const int Nx, const int Ny,
+		const num *const restrict exp_K,
+		const num *const restrict inv_exp_K,
+		const num *const restrict exp_halfK,
+		const num *const restrict inv_exp_halfK);
+
+void fftk_free(struct fftk *f);
+
+// A = M A, for N x N matrix A, where M is selected by which (FFTK_*)
+void fftk_lmul(const struct fftk *f, const int which, num *const restrict A);
+
+// A = A M
+void fftk_rmul(const struct fftk *f, const int which, num *const restrict A);
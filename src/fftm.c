@@ -0,0 +1,162 @@
+#include "fftm.h"
+#include <stdio.h>
+#include <complex.h>
+#include <mkl_dfti.h>
+
+// calls fn, and on a nonzero DFTI status prints it, frees h and returns NULL
+#define dfti_try(fn, ...) do { \
+	const MKL_LONG status = fn(__VA_ARGS__); \
+	if (status != 0) { \
+		fprintf(stderr, #fn "() failed: %ld\n", (long)status); \
+		if (h != NULL) DftiFreeDescriptor(&h); \
+		return NULL; \
+	} \
+} while (0);
+
+// n complex Nx x Ny transforms, the blocks contiguous
+static DFTI_DESCRIPTOR_HANDLE make_desc(const int Nx, const int Ny, const int n)
+{
+	DFTI_DESCRIPTOR_HANDLE h = NULL;
+	MKL_LONG len[2] = {Ny, Nx};
+	dfti_try(DftiCreateDescriptor, &h, DFTI_DOUBLE, DFTI_COMPLEX, 2, len);
+	dfti_try(DftiSetValue, h, DFTI_PLACEMENT, DFTI_NOT_INPLACE);
+	dfti_try(DftiSetValue, h, DFTI_NUMBER_OF_TRANSFORMS, (MKL_LONG)n);
+	dfti_try(DftiSetValue, h, DFTI_INPUT_DISTANCE, (MKL_LONG)(Nx*Ny));
+	dfti_try(DftiSetValue, h, DFTI_OUTPUT_DISTANCE, (MKL_LONG)(Nx*Ny));
+	dfti_try(DftiCommitDescriptor, h);
+	return h;
+}
+
+#undef dfti_try
+
+// committed descriptors by (Nx, Ny, n). the measurements and saves of one
+// run use 4 different n
+#define FFTM_MAX_DESC 8
+static struct {
+	int Nx, Ny, n;
+	DFTI_DESCRIPTOR_HANDLE h;
+} desc[FFTM_MAX_DESC];
+static int n_desc = 0;
+
+// the descriptor for (Nx, Ny, n), committed on first use. NULL on failure
+static DFTI_DESCRIPTOR_HANDLE get_desc(const int Nx, const int Ny, const int n)
+{
+	DFTI_DESCRIPTOR_HANDLE h = NULL;
+	#pragma omp critical (fftm_desc)
+	{
+	for (int k = 0; k < n_desc && h == NULL; k++)
+		if (desc[k].Nx == Nx && desc[k].Ny == Ny && desc[k].n == n)
+			h = desc[k].h;
+	if (h == NULL && n_desc == FFTM_MAX_DESC)
+		fprintf(stderr, "fftm: more than %d descriptors\n", FFTM_MAX_DESC);
+	else if (h == NULL) {
+		h = make_desc(Nx, Ny, n);
+		if (h != NULL) {
+			desc[n_desc].Nx = Nx;
+			desc[n_desc].Ny = Ny;
+			desc[n_desc].n = n;
+			desc[n_desc].h = h;
+			n_desc++;
+		}
+	}
+	}
+	return h;
+}
+
+int fftm_init(const int Nx, const int Ny, const int L)
+{
+	const int n[4] = {1, 2, L, 2*L};
+	for (int k = 0; k < 4; k++)
+		if (get_desc(Nx, Ny, n[k]) == NULL)
+			return -1;
+	return 0;
+}
+
+void fftm_free(void)
+{
+	#pragma omp critical (fftm_desc)
+	{
+	for (int k = n_desc - 1; k >= 0; k--)
+		DftiFreeDescriptor(&desc[k].h);
+	n_desc = 0;
+	}
+}
+
+// calls fn, and on a nonzero DFTI status prints it and goes to cleanup
+#define dfti_check(fn, ...) do { \
+	const MKL_LONG status = fn(__VA_ARGS__); \
+	if (status != 0) { \
+		fprintf(stderr, #fn "() failed: %ld\n", (long)status); \
+		goto cleanup; \
+	} \
+} while (0);
+
+// the transform of c is A(q) B(-q)
+int fftm_corr(const int Nx, const int Ny, const int n,
+		const num *const restrict a, const num *const restrict b,
+		num *const restrict c)
+{
+	const int N = Nx*Ny;
+	int status = -1;
+	double complex *const restrict x = my_calloc(N*n * sizeof(double complex));
+	double complex *const restrict ak = my_calloc(N*n * sizeof(double complex));
+	double complex *const restrict bk = my_calloc(N*n * sizeof(double complex));
+	const DFTI_DESCRIPTOR_HANDLE h = get_desc(Nx, Ny, n);
+	if (h == NULL) goto cleanup;
+
+	for (int i = 0; i < N*n; i++) x[i] = a[i];
+	dfti_check(DftiComputeForward, h, x, ak);
+	for (int i = 0; i < N*n; i++) x[i] = b[i];
+	dfti_check(DftiComputeForward, h, x, bk);
+	for (int m = 0; m < n; m++)
+	for (int ky = 0; ky < Ny; ky++)
+	for (int kx = 0; kx < Nx; kx++) {
+		const int k = kx + Nx*ky + N*m;
+		const int mk = (Nx - kx)%Nx + Nx*((Ny - ky)%Ny) + N*m;
+		x[k] = ak[k]*bk[mk]/N;
+	}
+	dfti_check(DftiComputeBackward, h, x, ak);
+	status = 0;
+
+cleanup:
+	for (int i = 0; i < N*n; i++)
+#ifdef USE_CPLX
+		c[i] = (status == 0) ? ak[i] : 0.0;
+#else
+		c[i] = (status == 0) ? creal(ak[i]) : 0.0;
+#endif
+
+	my_free(bk);
+	my_free(ak);
+	my_free(x);
+	return status;
+}
+
+int fftm_sq(const int Nx, const int Ny, const int n,
+		const num *const restrict O, num *const restrict S)
+{
+	const int N = Nx*Ny;
+	int status = -1;
+	double complex *const restrict x = my_calloc(N*n * sizeof(double complex));
+	double complex *const restrict xk = my_calloc(N*n * sizeof(double complex));
+	const DFTI_DESCRIPTOR_HANDLE h = get_desc(Nx, Ny, n);
+	if (h == NULL) goto cleanup;
+
+	for (int i = 0; i < N*n; i++) x[i] = O[i];
+	dfti_check(DftiComputeForward, h, x, xk);
+	status = 0;
+
+cleanup:
+	for (int i = 0; i < N*n; i++)
+#ifdef USE_CPLX
+		S[i] = (status == 0) ? xk[i] : 0.0;
+#else
+		S[i] = (status == 0) ? creal(xk[i]) : 0.0;
+#endif
+
+	my_free(xk);
+	my_free(x);
+	return status;
+}
+
+#undef dfti_check
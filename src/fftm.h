@@ -0,0 +1,28 @@
+#pragma once
+
+#include "util.h"
+
+// 2D FFTs for the translation invariant 2 site measurements (meas_fft), on
+// a periodic Nx x Ny lattice. site and displacement r = rx + Nx*ry, momentum
+// q = 2 pi (kx/Nx, ky/Ny) at kx + Nx*ky, all arrays of n blocks of Nx*Ny
+//
+// the DFTI descriptor for each (Nx, Ny, n) is committed on first use and
+// kept until fftm_free(), shared by all threads
+
+// sets up the descriptors for the n used by the measurements and saves
+// (1, 2, L, 2L). returns -1 if the DFTI setup fails
+int fftm_init(const int Nx, const int Ny, const int L);
+
+void fftm_free(void);
+
+// c(r) = sum_j a(j + r) b(j) for each block. returns -1 (and c = 0) if a
+// DFTI call fails
+int fftm_corr(const int Nx, const int Ny, const int n,
+		const num *const restrict a, const num *const restrict b,
+		num *const restrict c);
+
+// S(q) = sum_r exp(-i q.r) O(r) for each block. without USE_CPLX, the
+// real part (the cosine transform), since O(r) = O(-r) on average.
+// returns -1 (and S = 0) if a DFTI call fails
+int fftm_sq(const int Nx, const int Ny, const int n,
+		const num *const restrict O, num *const restrict S);
@@ -58,16 +58,156 @@ int get_lwork_eq_g(const int N)
 	xunmqr("R", "C", N, N, N, NULL, N, NULL, NULL, N, &lwork, -1, &info);
 	if (creal(lwork) > max_lwork) max_lwork = (int)lwork;
 
+	xunmqr("L", "N", N, N, N, NULL, N, NULL, NULL, N, &lwork, -1, &info);
+	if (creal(lwork) > max_lwork) max_lwork = (int)lwork;
+
+	xunmqr("L", "C", N, N, N, NULL, N, NULL, NULL, N, &lwork, -1, &info);
+	if (creal(lwork) > max_lwork) max_lwork = (int)lwork;
+
+	// STAB_SVD also keeps an N*N matrix and the singular values in work
+	xgesvd("A", "A", N, N, NULL, N, NULL, NULL, N, NULL, N, &lwork, -1, NULL, &info);
+	if (N*N + 3*N + (int)creal(lwork) > max_lwork) max_lwork = N*N + 3*N + (int)creal(lwork);
+
 	return max_lwork;
 }
 
+// QR factorization of g with columns ordered according to stab:
+// g P = Q R. on exit, Q and tau hold the factorization as returned by
+// geqrf, and pvt the (0-based) column order. v is overwritten
+static void stab_qr(const int N, const int stab, const num *const restrict g,
+		num *const restrict Q, num *const restrict tau,
+		num *const restrict v, int *const restrict pvt,
+		num *const restrict work, const int lwork)
+{
+	int info = 0;
+
+	if (stab == STAB_LDR) { // full column pivoting at every step
+		my_copy(Q, g, N*N);
+		for (int i = 0; i < N; i++) pvt[i] = 0;
+		xgeqp3(N, N, Q, N, pvt, tau, work, lwork, (double *)v, &info); // use v as RWORK
+		for (int i = 0; i < N; i++) pvt[i]--;
+		return;
+	}
+
+	if (stab == STAB_QR) {
+		for (int i = 0; i < N; i++) pvt[i] = i;
+	} else {
+		for (int j = 0; j < N; j++) { // use v for norms
+			v[j] = 0.0;
+			for (int i = 0; i < N; i++)
+				v[j] += g[i + j*N] * conj(g[i + j*N]);
+		}
+
+		pvt[0] = 0;
+		for (int i = 1; i < N; i++) { // insertion sort
+			int j;
+			for (j = i; j > 0 && creal(v[pvt[j-1]]) < creal(v[i]); j--)
+				pvt[j] = pvt[j-1];
+			pvt[j] = i;
+		}
+	}
+
+	for (int j = 0; j < N; j++) // pre-pivot
+		my_copy(Q + j*N, g + pvt[j]*N, N);
+
+	xgeqrf(N, N, Q, N, tau, work, lwork, &info);
+}
+
+// UDV version of calc_eq_g: the product is kept as U D V with U unitary
+// from an SVD at each step, instead of a QR factorization
+static num calc_eq_g_svd(const int l, const int N, const int L, const int n_mul,
+		const num *const restrict B, num *const restrict g,
+		num *const restrict U, num *const restrict T,
+		num *const restrict d, num *const restrict v,
+		int *const restrict pvt,
+		num *const restrict work, const int lwork,
+		double *const restrict logdet)
+{
+	int info = 0;
+	num *const restrict A = work;
+	double *const restrict s = (double *)(work + N*N);
+	double *const restrict rwork = s + N;
+	num *const restrict svd_work = work + N*N + 3*N;
+	const int svd_lwork = lwork - N*N - 3*N;
+
+	int m = (l + 1 + (L - 1) % n_mul) % L;
+	mul_seq(N, L, l, m, 1.0, B, g, N, A);
+	xgesvd("A", "A", N, N, g, N, s, U, N, T, N, svd_work, svd_lwork, rwork, &info);
+	for (int i = 0; i < N; i++) d[i] = s[i];
+
+	while (m != l) {
+		const int next = (m + n_mul) % L;
+		mul_seq(N, L, m, next, 1.0, B, g, N, A);
+		m = next;
+
+		xgemm("N", "N", N, N, N, 1.0, g, N, U, N, 0.0, A, N);
+		for (int j = 0; j < N; j++)
+			for (int i = 0; i < N; i++)
+				A[i + j*N] *= d[j];
+
+		xgesvd("A", "A", N, N, A, N, s, U, N, g, N, svd_work, svd_lwork, rwork, &info);
+		for (int i = 0; i < N; i++) d[i] = s[i];
+
+		xgemm("N", "N", N, N, N, 1.0, g, N, T, N, 0.0, A, N);
+		my_copy(T, A, N*N);
+	}
+
+	// phase of det(U), from an LU factorization
+	my_copy(A, U, N*N);
+	xgetrf(N, N, A, N, pvt, &info);
+	num phase = 1.0;
+	for (int i = 0; i < N; i++) {
+		phase *= A[i + N*i]/fabs(A[i + N*i]);
+		if (pvt[i] != i+1) phase *= -1.0;
+	}
+	phase = conj(phase);
+
+	// same as the end of calc_eq_g, with U^H in place of Q^H
+	for (int i = 0; i < N; i++) {
+		if (fabs(d[i]) > 1.0) { // v = 1/Db; d = Ds
+			v[i] = 1.0/d[i];
+			d[i] = 1.0;
+		} else {
+			v[i] = 1.0;
+		}
+	}
+
+	for (int j = 0; j < N; j++)
+		for (int i = 0; i < N; i++)
+			g[i + j*N] = v[i]*conj(U[j + i*N]);
+
+	for (int j = 0; j < N; j++)
+		for (int i = 0; i < N; i++)
+			T[i + j*N] = d[i]*T[i + j*N] + g[i + j*N];
+
+	xgetrf(N, N, T, N, pvt, &info);
+	xgetrs("N", N, N, T, N, pvt, g, N, &info);
+
+	double ld = 0.0;
+	for (int i = 0; i < N; i++) {
+		const num c = v[i]/T[i + N*i];
+		phase *= c/fabs(c);
+		ld -= log(fabs(c));
+		if (pvt[i] != i+1) phase *= -1.0;
+	}
+	if (logdet != NULL) *logdet = ld;
+
+	return 1.0/phase;
+}
+
 num calc_eq_g(const int l, const int N, const int L, const int n_mul,
+		const int stab,
 		const num *const restrict B, num *const restrict g,
 		num *const restrict Q, num *const restrict T,
 		num *const restrict tau, num *const restrict d,
 		num *const restrict v, int *const restrict pvt,
-		num *const restrict work, const int lwork)
+		num *const restrict work, const int lwork,
+		double *const restrict logdet)
 {
+	if (stab == STAB_SVD)
+		return calc_eq_g_svd(l, N, L, n_mul, B, g, Q, T, d, v, pvt,
+		                     work, lwork, logdet);
+
 	int info = 0;
 
 	// algorithm 3 of 10.1109/IPDPS.2012.37
@@ -80,8 +220,13 @@ num calc_eq_g(const int l, const int N, const int L, const int n_mul,
 	int m = (l + 1 + (L - 1) % n_mul) % L;
 	mul_seq(N, L, l, m, 1.0, B, Q, N, work);
 
-	for (int i = 0; i < N; i++) pvt[i] = 0;
-	xgeqp3(N, N, Q, N, pvt, tau, work, lwork, (double *)d, &info); // use d as RWORK
+	if (stab == STAB_QR) {
+		for (int i = 0; i < N; i++) pvt[i] = i + 1;
+		xgeqrf(N, N, Q, N, tau, work, lwork, &info);
+	} else {
+		for (int i = 0; i < N; i++) pvt[i] = 0;
+		xgeqp3(N, N, Q, N, pvt, tau, work, lwork, (double *)d, &info); // use d as RWORK
+	}
 
 	// (2)
 	for (int i = 0; i < N; i++) {
@@ -108,26 +253,8 @@ num calc_eq_g(const int l, const int N, const int L, const int n_mul,
 			for (int i = 0; i < N; i++)
 				g[i + j*N] *= d[j];
 
-		// (3b)
-		for (int j = 0; j < N; j++) { // use d for norms
-			d[j] = 0.0;
-			for (int i = 0; i < N; i++)
-				d[j] += g[i + j*N] * conj(g[i + j*N]);
-		}
-
-		pvt[0] = 0;
-		for (int i = 1; i < N; i++) { // insertion sort
-			int j;
-			for (j = i; j > 0 && creal(d[pvt[j-1]]) < creal(d[i]); j--)
-				pvt[j] = pvt[j-1];
-			pvt[j] = i;
-		}
-
-		for (int j = 0; j < N; j++) // pre-pivot
-			my_copy(Q + j*N, g + pvt[j]*N, N);
-
-		// (3c)
-		xgeqrf(N, N, Q, N, tau, work, lwork, &info);
+		// (3b), (3c)
+		stab_qr(N, stab, g, Q, tau, v, pvt, work, lwork);
 
 		// (3d)
 		for (int i = 0; i < N; i++) {
@@ -185,11 +312,14 @@ num calc_eq_g(const int l, const int N, const int L, const int n_mul,
 	// 		det *= -1.0;
 	// }
 
-	// probably can be done more efficiently but it's O(N) so whatev
+	// probably can be done more efficiently but it's O(N) so whatev.
+	// |det| of the householder reflectors is 1, so only c enters logdet
 	num phase = 1.0;
+	double ld = 0.0;
 	for (int i = 0; i < N; i++) {
 		const num c = v[i]/T[i + N*i];
 		phase *= c/fabs(c);
+		ld -= log(fabs(c));
 		double vv = 1.0;
 		for (int j = i + 1; j < N; j++)
 			vv += creal(Q[j + i*N])*creal(Q[j + i*N])
@@ -198,10 +328,159 @@ num calc_eq_g(const int l, const int N, const int L, const int n_mul,
 		phase *= fabs(ref)/ref;
 		if (pvt[i] != i+1) phase *= -1.0;
 	}
+	if (logdet != NULL) *logdet = ld;
 
 	return 1.0/phase;
 }
 
+// layout of one stored UDT decomposition A = Q D T
+#define UDT_Q(udt, N) (udt)
+#define UDT_T(udt, N) ((udt) + (N)*(N))
+#define UDT_TAU(udt, N) ((udt) + 2*(N)*(N))
+#define UDT_D(udt, N) ((udt) + 2*(N)*(N) + (N))
+
+void udt_identity(const int N, num *const restrict udt)
+{
+	for (int i = 0; i < UDT_SIZE(N); i++) udt[i] = 0.0;
+	for (int i = 0; i < N; i++) {
+		UDT_T(udt, N)[i + N*i] = 1.0;
+		UDT_D(udt, N)[i] = 1.0;
+	}
+}
+
+void udt_push(const int N, const int stab, const char *trans,
+		const num *const restrict C,
+		const num *const restrict in, num *const restrict out,
+		num *const restrict g, num *const restrict v,
+		int *const restrict pvt,
+		num *const restrict work, const int lwork)
+{
+	int info = 0;
+	const num *const restrict Qi = UDT_Q(in, N);
+	const num *const restrict Ti = UDT_T(in, N);
+	const num *const restrict taui = UDT_TAU(in, N);
+	const num *const restrict di = UDT_D(in, N);
+	num *const restrict Qo = UDT_Q(out, N);
+	num *const restrict To = UDT_T(out, N);
+	num *const restrict tauo = UDT_TAU(out, N);
+	num *const restrict d = UDT_D(out, N);
+
+	// same steps as (3a)-(3d) in calc_eq_g, but out of place
+	if (trans[0] == 'N')
+		my_copy(g, C, N*N);
+	else
+		for (int j = 0; j < N; j++)
+			for (int i = 0; i < N; i++)
+				g[i + j*N] = conj(C[j + i*N]);
+
+	xunmqr("R", "N", N, N, N, Qi, N, taui, g, N, work, lwork, &info);
+
+	for (int j = 0; j < N; j++)
+		for (int i = 0; i < N; i++)
+			g[i + j*N] *= di[j];
+
+	stab_qr(N, stab, g, Qo, tauo, v, pvt, work, lwork);
+
+	for (int i = 0; i < N; i++) {
+		d[i] = Qo[i + i*N];
+		if (d[i] == 0.0) d[i] = 1.0;
+		v[i] = 1.0/d[i];
+	}
+
+	for (int j = 0; j < N; j++)
+		for (int i = 0; i <= j; i++)
+			Qo[i + j*N] *= v[i];
+
+	for (int j = 0; j < N; j++)
+		for (int i = 0; i < N; i++)
+			To[i + j*N] = Ti[pvt[i] + j*N];
+
+	xtrmm("L", "U", "N", "N", N, N, 1.0, Qo, N, To, N);
+}
+
+// phase of the determinant of the orthogonal/unitary Q of a QR factorization
+static num qr_det_phase(const int N, const num *const restrict Q,
+		const num *const restrict tau)
+{
+	num phase = 1.0;
+	for (int i = 0; i < N; i++) {
+		double vv = 1.0;
+		for (int j = i + 1; j < N; j++)
+			vv += creal(Q[j + i*N])*creal(Q[j + i*N])
+			    + cimag(Q[j + i*N])*cimag(Q[j + i*N]);
+		const num ref = 1.0 - tau[i]*vv;
+		phase *= ref/fabs(ref);
+	}
+	return phase;
+}
+
+num calc_eq_g_udt(const int N, const num *const restrict R,
+		const num *const restrict Lh, num *const restrict g,
+		num *const restrict M, num *const restrict rb,
+		num *const restrict lb, int *const restrict pvt,
+		num *const restrict work, const int lwork,
+		double *const restrict logdet)
+{
+	int info = 0;
+	const num *const restrict Qr = UDT_Q(R, N);
+	const num *const restrict Tr = UDT_T(R, N);
+	const num *const restrict taur = UDT_TAU(R, N);
+	const num *const restrict dr = UDT_D(R, N);
+	const num *const restrict Ql = UDT_Q(Lh, N);
+	const num *const restrict Tl = UDT_T(Lh, N);
+	const num *const restrict taul = UDT_TAU(Lh, N);
+	const num *const restrict dl = UDT_D(Lh, N);
+
+	// R = Qr Dr Tr and L^H = Ql Dl Tl, so with D = Db Ds split as in
+	// calc_eq_g,
+	// G = (1 + R L)^-1 = Ql Dlb^-1 M^-1 Drb^-1 Qr^H, where
+	// M = Drb^-1 Qr^H Ql Dlb^-1 + Drs Tr Tl^H Dls (Dl conjugated)
+	for (int i = 0; i < N; i++) {
+		rb[i] = (fabs(dr[i]) > 1.0) ? 1.0/dr[i] : 1.0;
+		lb[i] = (fabs(dl[i]) > 1.0) ? 1.0/conj(dl[i]) : 1.0;
+	}
+
+	xgemm("N", "C", N, N, N, 1.0, Tr, N, Tl, N, 0.0, g, N);
+
+	for (int i = 0; i < N*N; i++) M[i] = 0.0;
+	for (int i = 0; i < N; i++) M[i + i*N] = 1.0;
+	xunmqr("L", "N", N, N, N, Ql, N, taul, M, N, work, lwork, &info);
+	xunmqr("L", "C", N, N, N, Qr, N, taur, M, N, work, lwork, &info);
+
+	for (int j = 0; j < N; j++) {
+		const num ls = conj(dl[j]) * lb[j];
+		for (int i = 0; i < N; i++)
+			M[i + j*N] = rb[i]*M[i + j*N]*lb[j]
+			           + dr[i]*rb[i]*g[i + j*N]*ls;
+	}
+
+	for (int i = 0; i < N*N; i++) g[i] = 0.0;
+	for (int i = 0; i < N; i++) g[i + i*N] = rb[i];
+	xunmqr("R", "C", N, N, N, Qr, N, taur, g, N, work, lwork, &info);
+
+	xgetrf(N, N, M, N, pvt, &info);
+	xgetrs("N", N, N, M, N, pvt, g, N, &info);
+
+	for (int j = 0; j < N; j++)
+		for (int i = 0; i < N; i++)
+			g[i + j*N] *= lb[i];
+
+	xunmqr("L", "N", N, N, N, Ql, N, taul, g, N, work, lwork, &info);
+
+	// phase of det(G^-1) = det(Qr Drb M Dlb Ql^H). |det| of Qr and Ql is 1
+	num phase = qr_det_phase(N, Qr, taur) * conj(qr_det_phase(N, Ql, taul));
+	double ld = 0.0;
+	for (int i = 0; i < N; i++) {
+		const num c = M[i + N*i] / (rb[i]*lb[i]);
+		phase *= c/fabs(c);
+		ld += log(fabs(c));
+		if (pvt[i] != i+1) phase *= -1.0;
+	}
+	if (logdet != NULL) *logdet = ld;
+
+	return phase;
+}
+
 int get_lwork_ue_g(const int N, const int L)
 {
 	num lwork;
@@ -484,121 +763,237 @@ void calc_ue_g(const int N, const int L, const int F, const int n_mul,
 	profile_end(expand_g);
 }
 
-static void expand_g_full(const int N, const int L, const int E, const int n_matmul,
-		const num *const restrict B,
-		const num *const restrict iB,
-		const num *const restrict Gred,
-		num *const restrict G)
+void calc_ue_g_red(const int N, const int F, const int n_mul,
+		const num *const restrict C,
+		num *const restrict Gred,
+		num *const restrict tau,
+		num *const restrict Q,
+		num *const restrict work, const int lwork)
 {
-	const int ldG = N;
+	const int E = 1 + (F - 1) / n_mul;
 
-	#define G_BLK(i, j) (G + N*N*((i) +  L*(j)))
-	// copy Gred to G
-	for (int f = 0; f < E; f++)
-	for (int e = 0; e < E; e++) {
-		const int l = f*n_matmul;
-		const int k = e*n_matmul;
-		for (int j = 0; j < N; j++)
+	profile_begin(calc_o);
+	calc_o(N, F, n_mul, C, Gred, work);
+	profile_end(calc_o);
+
+	profile_begin(bsofi);
+	bsofi(N, E, Gred, tau, Q, work, lwork);
+	profile_end(bsofi);
+}
+
+// single steps of the expansion of Gred. Y is the block next to X = G(k, m)
+// (left, right) or X = G(m, l) (up, down). crossing the diagonal k == m or
+// l == m adds or removes the identity and crossing slice 0 flips the sign
+static void ue_left(const struct ue_g *const ue, const int k, const int m,
+		const num *const restrict X, num *const restrict Y)
+{
+	const int N = ue->N, L = ue->L;
+	const int next = (m - 1 + L) % L;
+	const num alpha = (m == 0) ? -1.0 : 1.0;
+	xgemm("N", "N", N, N, N, alpha, X, N, ue->B + N*N*next, N, 0.0, Y, N);
+	if (next == k)
 		for (int i = 0; i < N; i++)
-			G_BLK(k, l)[i + ldG*j] = Gred[(i + N*e) + N*E*(j + N*f)];
-	}
+			Y[i + N*i] += 1.0;
+}
 
-	// number of steps to move in each direction
-	// except for boundaries, when L % n_matmul != 0
+static void ue_right(const struct ue_g *const ue, const int k, const int m,
+		const num *const restrict X, num *const restrict Y)
+{
+	const int N = ue->N, L = ue->L;
+	const int next = (m + 1) % L;
+	const num alpha = (next == 0) ? -1.0 : 1.0;
+	const num beta = (k == m) ? -alpha : 0.0;
+	if (k == m)
+		my_copy(Y, ue->iB + N*N*m, N*N);
+	xgemm("N", "N", N, N, N, alpha, X, N, ue->iB + N*N*m, N, beta, Y, N);
+}
+
+static void ue_up(const struct ue_g *const ue, const int l, const int m,
+		const num *const restrict X, num *const restrict Y)
+{
+	const int N = ue->N, L = ue->L;
+	const int next = (m - 1 + L) % L;
+	const num alpha = (m == 0) ? -1.0 : 1.0;
+	const num beta = (m == l) ? -alpha : 0.0;
+	if (m == l)
+		my_copy(Y, ue->iB + N*N*next, N*N);
+	xgemm("N", "N", N, N, N, alpha, ue->iB + N*N*next, N, X, N, beta, Y, N);
+}
+
+static void ue_down(const struct ue_g *const ue, const int l, const int m,
+		const num *const restrict X, num *const restrict Y)
+{
+	const int N = ue->N, L = ue->L;
+	const int next = (m + 1) % L;
+	const num alpha = (next == 0) ? -1.0 : 1.0;
+	xgemm("N", "N", N, N, N, alpha, ue->B + N*N*m, N, X, N, 0.0, Y, N);
+	if (next == l)
+		for (int i = 0; i < N; i++)
+			Y[i + N*i] += 1.0;
+}
+
+// block e of Gred whose expansion covers slice t, and the number of steps
+// from slice e*n_matmul to t (negative: left/up)
+static int ue_band(const struct ue_g *const ue, const int t, int *const steps)
+{
+	const int L = ue->L, E = ue->E, n_matmul = ue->n_matmul;
 	const int n_left = (n_matmul - 1)/2;
 	const int n_right = n_matmul/2;
-	const int n_up = n_left;
-	const int n_down = n_right;
-
 	const int rstop_last = ((E - 1)*n_matmul + L)/2;
 	const int lstop_first = (rstop_last + 1) % L;
-	const int dstop_last = rstop_last;
-	const int ustop_first = lstop_first;
 
-	// left and right
-	for (int f = 0; f < E; f++)
 	for (int e = 0; e < E; e++) {
-		const int l = f*n_matmul;
-		const int k = e*n_matmul;
-		const int lstop = (f == 0) ? lstop_first : l - n_left;
-		const int rstop = (f == E - 1) ? rstop_last : l + n_right;
+		const int l = e*n_matmul;
+		const int lstop = (e == 0) ? lstop_first : l - n_left;
+		const int rstop = (e == E - 1) ? rstop_last : l + n_right;
+		*steps = 0;
+		if (t == l) return e;
 		for (int m = l; m != lstop;) {
-			const int next = (m - 1 + L) % L;
-			const num alpha = (m == 0) ? -1.0 : 1.0;
-			xgemm("N", "N", N, N, N, alpha,
-			      G_BLK(k, m), ldG, B + N*N*next, N, 0.0,
-			      G_BLK(k, next), ldG);
-			m = next;
+			m = (m - 1 + L) % L;
+			(*steps)--;
+			if (m == t) return e;
 		}
+		*steps = 0;
 		for (int m = l; m != rstop;) {
-			const int next = (m + 1) % L;
-			const num alpha = (next == 0) ? -1.0 : 1.0;
-			const num beta = (k == m) ? -alpha : 0.0;
-			if (k == m)
-				for (int j = 0; j < N; j++)
-				for (int i = 0; i < N; i++)
-					G_BLK(k, next)[i + ldG*j] = iB[i + N*j + N*N*m];
-			xgemm("N", "N", N, N, N, alpha,
-			      G_BLK(k, m), ldG, iB + N*N*m, N, beta,
-			      G_BLK(k, next), ldG);
-			m = next;
+			m = (m + 1) % L;
+			(*steps)++;
+			if (m == t) return e;
+		}
+	}
+	*steps = 0;
+	return 0; // not reached
+}
+
+// copy block (e, f) of Gred to X
+static void ue_gred_blk(const struct ue_g *const ue, const int e, const int f,
+		num *const restrict X)
+{
+	const int N = ue->N, NE = ue->N*ue->E;
+	for (int j = 0; j < N; j++)
+	for (int i = 0; i < N; i++)
+		X[i + N*j] = ue->Gred[(i + N*e) + NE*(j + N*f)];
+}
+
+// G(k, m0) in X -> G(k, m0 + steps) in X, using Y as temporary
+static void ue_walk_row(const struct ue_g *const ue, const int k, int m,
+		const int steps, num *const restrict X, num *const restrict Y)
+{
+	const int N = ue->N, L = ue->L;
+	const int n = (steps < 0) ? -steps : steps;
+	for (int s = 0; s < n; s++) {
+		if (steps < 0) {
+			ue_left(ue, k, m, X, Y);
+			m = (m - 1 + L) % L;
+		} else {
+			ue_right(ue, k, m, X, Y);
+			m = (m + 1) % L;
 		}
+		my_copy(X, Y, N*N);
+	}
+}
+
+// G(m0, l) in X -> G(m0 + steps, l) in X
+static void ue_walk_col(const struct ue_g *const ue, const int l, int m,
+		const int steps, num *const restrict X, num *const restrict Y)
+{
+	const int N = ue->N, L = ue->L;
+	const int n = (steps < 0) ? -steps : steps;
+	for (int s = 0; s < n; s++) {
+		if (steps < 0) {
+			ue_up(ue, l, m, X, Y);
+			m = (m - 1 + L) % L;
+		} else {
+			ue_down(ue, l, m, X, Y);
+			m = (m + 1) % L;
+		}
+		my_copy(X, Y, N*N);
+	}
+}
+
+void ue_g_col(const struct ue_g *const ue, const int l, num *const restrict G,
+		num *const restrict tmp)
+{
+	const int N = ue->N, L = ue->L, E = ue->E, n_matmul = ue->n_matmul;
+	int s;
+	const int f = ue_band(ue, l, &s);
+
+	// G(k, l) for the rows k of Gred
+	for (int e = 0; e < E; e++) {
+		const int k = e*n_matmul;
+		ue_gred_blk(ue, e, f, tmp);
+		ue_walk_row(ue, k, f*n_matmul, s, tmp, tmp + N*N);
+		my_copy(G + N*N*k, tmp, N*N);
 	}
 
-	// up and down
-	for (int e = 0; e < E; e++)
-	for (int l = 0; l < L; l++) {
+	// up and down from there
+	const int n_up = (n_matmul - 1)/2;
+	const int n_down = n_matmul/2;
+	const int dstop_last = ((E - 1)*n_matmul + L)/2;
+	const int ustop_first = (dstop_last + 1) % L;
+	for (int e = 0; e < E; e++) {
 		const int k = e*n_matmul;
 		const int ustop = (e == 0) ? ustop_first : k - n_up;
 		const int dstop = (e == E - 1) ? dstop_last : k + n_down;
 		for (int m = k; m != ustop;) {
 			const int next = (m - 1 + L) % L;
-			const num alpha = (m == 0) ? -1.0 : 1.0;
-			const num beta = (m == l) ? -alpha : 0.0;
-			if (m == l)
-				for (int j = 0; j < N; j++)
-				for (int i = 0; i < N; i++)
-					G_BLK(next, l)[i + ldG*j] = iB[i + N*j + N*N*next];
-			xgemm("N", "N", N, N, N, alpha,
-			      iB + N*N*next, N, G_BLK(m, l), ldG, beta,
-			      G_BLK(next, l), ldG);
+			ue_up(ue, l, m, G + N*N*m, G + N*N*next);
 			m = next;
 		}
 		for (int m = k; m != dstop;) {
 			const int next = (m + 1) % L;
-			const num alpha = (next == 0) ? -1.0 : 1.0;
-			xgemm("N", "N", N, N, N, alpha,
-			      B + N*N*m, N, G_BLK(m, l), ldG, 0.0,
-			      G_BLK(next, l), ldG);
-			if (next == l)
-				for (int i = 0; i < N; i++)
-					G_BLK(next, l)[i + ldG*i] += 1.0;
+			ue_down(ue, l, m, G + N*N*m, G + N*N*next);
 			m = next;
 		}
 	}
-	#undef G_BLK
 }
 
-void calc_ue_g_full(const int N, const int L, const int F, const int n_mul,
-		const num *const restrict B, const num *const restrict iB,
-		const num *const restrict C,
-		num *const restrict G,
-		num *const restrict Gred,
-		num *const restrict tau,
-		num *const restrict Q,
-		num *const restrict work, const int lwork)
+void ue_g_row(const struct ue_g *const ue, const int k, num *const restrict G,
+		num *const restrict tmp)
 {
-	const int E = 1 + (F - 1) / n_mul;
+	const int N = ue->N, L = ue->L, E = ue->E, n_matmul = ue->n_matmul;
+	int s;
+	const int e = ue_band(ue, k, &s);
 
-	profile_begin(calc_o);
-	calc_o(N, F, n_mul, C, Gred, work);
-	profile_end(calc_o);
+	// G(k, l) for the columns l of Gred
+	for (int f = 0; f < E; f++) {
+		const int l = f*n_matmul;
+		ue_gred_blk(ue, e, f, tmp);
+		ue_walk_col(ue, l, e*n_matmul, s, tmp, tmp + N*N);
+		my_copy(G + N*N*l, tmp, N*N);
+	}
 
-	profile_begin(bsofi);
-	bsofi(N, E, Gred, tau, Q, work, lwork);
-	profile_end(bsofi);
+	// left and right from there
+	const int n_left = (n_matmul - 1)/2;
+	const int n_right = n_matmul/2;
+	const int rstop_last = ((E - 1)*n_matmul + L)/2;
+	const int lstop_first = (rstop_last + 1) % L;
+	for (int f = 0; f < E; f++) {
+		const int l = f*n_matmul;
+		const int lstop = (f == 0) ? lstop_first : l - n_left;
+		const int rstop = (f == E - 1) ? rstop_last : l + n_right;
+		for (int m = l; m != lstop;) {
+			const int next = (m - 1 + L) % L;
+			ue_left(ue, k, m, G + N*N*m, G + N*N*next);
+			m = next;
+		}
+		for (int m = l; m != rstop;) {
+			const int next = (m + 1) % L;
+			ue_right(ue, k, m, G + N*N*m, G + N*N*next);
+			m = next;
+		}
+	}
+}
 
-	profile_begin(expand_g);
-	expand_g_full(N, L, E, (L/F) * n_mul, B, iB, Gred, G);
-	profile_end(expand_g);
+void ue_g_diag(const struct ue_g *const ue, num *const restrict G,
+		num *const restrict tmp)
+{
+	const int N = ue->N, L = ue->L, n_matmul = ue->n_matmul;
+	for (int t = 0; t < L; t++) {
+		int s;
+		const int e = ue_band(ue, t, &s);
+		ue_gred_blk(ue, e, e, tmp);
+		ue_walk_row(ue, e*n_matmul, e*n_matmul, s, tmp, tmp + N*N);
+		ue_walk_col(ue, t, e*n_matmul, s, tmp, tmp + N*N);
+		my_copy(G + N*N*t, tmp, N*N);
+	}
 }
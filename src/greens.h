@@ -8,16 +8,53 @@ void mul_seq(const int N, const int L,
 		num *const restrict A, const int ldA,
 		num *const restrict work);
 
+// stabilization methods for calc_eq_g and udt_push, set by /params/stab
+enum {
+	STAB_QRP = 0, // QR with columns pre-sorted by norm (default)
+	STAB_QR = 1,  // QR without pivoting
+	STAB_SVD = 2, // UDV from SVD; not supported by udt_push
+	STAB_LDR = 3, // QR with full column pivoting at each step
+};
+
 int get_lwork_eq_g(const int N);
 
 num calc_eq_g(const int l, const int N, const int L, const int n_mul,
+		const int stab,
 		const num *const restrict B, num *const restrict g,
 		// work arrays
 		num *const restrict Q, num *const restrict T,
 		num *const restrict tau, num *const restrict d,
 		num *const restrict v, int *const restrict pvt,
+		num *const restrict work, const int lwork,
+		// if not NULL, log|det(I + B_l-1 ... B_l)| is stored here
+		double *const restrict logdet);
+
+// number of nums needed to store one UDT decomposition
+#define UDT_SIZE(N) (2*(N)*(N) + 2*(N))
+
+void udt_identity(const int N, num *const restrict udt);
+
+// out = op(C) * in, as a new UDT decomposition. op(C) = C if trans is "N",
+// C^H if trans is "C"
+void udt_push(const int N, const int stab, const char *trans,
+		const num *const restrict C,
+		const num *const restrict in, num *const restrict out,
+		// work arrays
+		num *const restrict g, num *const restrict v,
+		int *const restrict pvt,
 		num *const restrict work, const int lwork);
 
+// g = (1 + R L)^-1, where R and L^H are stored UDT decompositions.
+// returns phase of det(1 + R L)
+num calc_eq_g_udt(const int N, const num *const restrict R,
+		const num *const restrict Lh, num *const restrict g,
+		// work arrays (sizes: N*N, N, N, N)
+		num *const restrict M, num *const restrict rb,
+		num *const restrict lb, int *const restrict pvt,
+		num *const restrict work, const int lwork,
+		// if not NULL, log|det(1 + R L)| is stored here
+		double *const restrict logdet);
+
 int get_lwork_ue_g(const int N, const int L);
 
 void calc_ue_g(const int N, const int L, const int F, const int n_mul,
@@ -30,11 +67,30 @@ void calc_ue_g(const int N, const int L, const int F, const int n_mul,
 		num *const restrict Q,
 		num *const restrict work, const int lwork);
 
-void calc_ue_g_full(const int N, const int L, const int F, const int n_mul,
-		const num *const restrict B, const num *const restrict iB,
+// reduced unequal-time G only: Gred = O^-1 for the F products C, from which
+// the blocks of G are generated on demand by ue_g_*
+void calc_ue_g_red(const int N, const int F, const int n_mul,
 		const num *const restrict C,
-		num *const restrict G, // NL * NL
-		num *const restrict Gred, // NF * NF
-		num *const restrict tau, // NF
+		num *const restrict Gred, // NE * NE, E = 1 + (F - 1)/n_mul
+		num *const restrict tau, // NE
 		num *const restrict Q, // 2*N * 2*N
 		num *const restrict work, const int lwork);
+
+// everything needed to expand Gred into blocks G(k, l) of the unequal-time G
+struct ue_g {
+	int N, L, E, n_matmul; // n_matmul: slices per block of Gred
+	const num *B, *iB;     // L each
+	const num *Gred;
+};
+
+// G[m] = G(m, l) for all m (N*N*L)
+void ue_g_col(const struct ue_g *const ue, const int l, num *const restrict G,
+		num *const restrict tmp); // tmp: 2*N*N
+
+// G[m] = G(k, m) for all m
+void ue_g_row(const struct ue_g *const ue, const int k, num *const restrict G,
+		num *const restrict tmp);
+
+// G[m] = G(m, m) for all m
+void ue_g_diag(const struct ue_g *const ue, num *const restrict G,
+		num *const restrict tmp);
@@ -115,6 +115,20 @@ static inline void xgeqrf(const int m, const int n, num* a, const int lda, num*
 	&m, &n, cast(a), &lda, cast(tau), cast(work), &lwork, info);
 }
 
+static inline void xgesvd(const char* jobu, const char* jobvt,
+		const int m, const int n, num* a, const int lda, double* s,
+		num* u, const int ldu, num* vt, const int ldvt,
+		num* work, const int lwork, double* rwork, int* info)
+{
+#ifdef USE_CPLX
+	zgesvd(jobu, jobvt, &m, &n, cast(a), &lda, s, cast(u), &ldu,
+	cast(vt), &ldvt, cast(work), &lwork, rwork, info);
+#else
+	dgesvd(jobu, jobvt, &m, &n, cast(a), &lda, s, cast(u), &ldu,
+	cast(vt), &ldvt, cast(work), &lwork, info); // rwork not used
+#endif
+}
+
 static inline void xunmqr(const char* side, const char* trans,
 		const int m, const int n, const int k, const num* a,
 		const int lda, const num* tau, num* c,
@@ -140,5 +154,17 @@ static inline void xtrtri(const char* uplo, const char* diag, const int n,
 	uplo, diag, &n, cast(a), &lda, info);
 }
 
+static inline void xtrtrs(const char* uplo, const char* trans, const char* diag,
+		const int n, const int nrhs, const num* a, const int lda,
+		num* b, const int ldb, int* info)
+{
+#ifdef USE_CPLX
+	ztrtrs(
+#else
+	dtrtrs(
+#endif
+	uplo, trans, diag, &n, &nrhs, ccast(a), &lda, cast(b), &ldb, info);
+}
+
 #undef ccast
 #undef cast
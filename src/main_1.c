@@ -7,7 +7,7 @@
 
 static void usage(const char *name)
 {
-	printf("usage: %s [-b] [-l log_file.log] [-t max_time] sim_file.h5\n", name);
+	printf("usage: %s [-b] [-T] [-l log_file.log] [-t max_time] sim_file.h5\n", name);
 }
 
 int main(int argc, char **argv)
@@ -16,13 +16,17 @@ int main(int argc, char **argv)
 	char *log_file = NULL;
 	char *max_time = "0";
 	int bench = 0;
+	int tune = 0;
 
 	int c;
-	while ((c = getopt(argc, argv, "bl:t:")) != -1)
+	while ((c = getopt(argc, argv, "bTl:t:")) != -1)
 		switch (c) {
 		case 'b':
 			bench = 1;
 			break;
+		case 'T':
+			tune = 1;
+			break;
 		case 'l':
 			log_file = optarg;
 			break;
@@ -40,7 +44,7 @@ int main(int argc, char **argv)
 	}
 
 	int status = dqmc_wrapper(argv[optind], log_file,
-	                          atoi(max_time) * TICK_PER_SEC, bench);
+	                          atoi(max_time) * TICK_PER_SEC, bench, tune);
 
 	if (status < 0) {
 		fprintf(stderr, "dqmc_wrapper() failed: %d", status);
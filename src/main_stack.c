@@ -325,7 +325,7 @@ int main(int argc, char **argv)
 			t_remain = 0;
 
 		my_printf("starting: %s\n", sim_file);
-		status = dqmc_wrapper(sim_file, log_file, t_remain, 0);
+		status = dqmc_wrapper(sim_file, log_file, t_remain, 0, 0);
 
 		if (status > 0) {
 			my_printf("checkpointed: %s\n", sim_file);
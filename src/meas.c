@@ -1,6 +1,10 @@
 #include "meas.h"
 #include "data.h"
+#include "fftm.h"
+#include "greens.h"
+#include "rand.h"
 #include "util.h"
+#include <omp.h>
 #include <stdio.h>
 // number of types of bonds kept for 4-particle nematic correlators.
 // 2 by default since these are slow measurerments
@@ -24,9 +28,84 @@
 #define pdj1j0 1
 #endif
 
+// 2 site measurements for meas_fft, at one time displacement. the class of
+// i and j is their displacement r = rx + Nx*ry itself, computed instead of
+// looked up in map_ij. the disconnected parts of nn and zz, convolutions of
+// the site densities (nc) and moments (sc), come from fftm_corr().
+// G_ii from g?tt, G_ij from g?t0, G_ji from g?0t, G_jj from g?00
+static void meas_2site_fft(const struct params *const restrict p,
+		const num pre, const int delta_t,
+		const num *const restrict gutt, const num *const restrict gut0,
+		const num *const restrict gu0t, const num *const restrict gu00,
+		const num *const restrict gdtt, const num *const restrict gdt0,
+		const num *const restrict gd0t, const num *const restrict gd00,
+		const num *const restrict nc, const num *const restrict sc,
+		num *const restrict g, num *const restrict nn,
+		num *const restrict xx, num *const restrict zz,
+		num *const restrict pair_sw,
+		num *const restrict vv, num *const restrict vn)
+{
+	const int N = p->N, Nx = p->Nx, Ny = p->Ny;
+	for (int r = 0; r < N; r++) {
+		nn[r] += pre*nc[r];
+		zz[r] += 0.25*pre*sc[r];
+	}
+	for (int j = 0; j < N; j++) {
+		const int jx = j % Nx, jy = j / Nx;
+		const num gujj = gu00[j + N*j], gdjj = gd00[j + N*j];
+	for (int iy = 0; iy < Ny; iy++) {
+		const int ry = (iy >= jy) ? iy - jy : iy - jy + Ny;
+	for (int ix = 0; ix < Nx; ix++) {
+		const int rx = (ix >= jx) ? ix - jx : ix - jx + Nx;
+		const int i = ix + Nx*iy, r = rx + Nx*ry;
+		const int delta_tij = delta_t * (r == 0);
+		const num guii = gutt[i + N*i];
+		const num guij = gut0[i + N*j];
+		const num guji = gu0t[j + N*i];
+		const num gdii = gdtt[i + N*i];
+		const num gdij = gdt0[i + N*j];
+		const num gdji = gd0t[j + N*i];
+#ifdef USE_PEIERLS
+		g[r] += 0.5*pre*(guij*p->peierlsu[j + i*N] + gdij*p->peierlsd[j + i*N]);
+#else
+		g[r] += 0.5*pre*(guij + gdij);
+#endif
+		const num x = delta_tij*(guii + gdii) - (guji*guij + gdji*gdij);
+		nn[r] += pre*x;
+		xx[r] += 0.25*pre*(delta_tij*(guii + gdii) - (guji*gdij + gdji*guij));
+		zz[r] += 0.25*pre*x;
+		pair_sw[r] += pre*guij*gdij;
+		if (vv != NULL) {
+			const num nuinuj = (1. - guii)*(1. - gujj) + (delta_tij - guji)*guij;
+			const num ndindj = (1. - gdii)*(1. - gdjj) + (delta_tij - gdji)*gdij;
+			vv[r] += pre*nuinuj*ndindj;
+			vn[r] += pre*(nuinuj*(1. - gdii) + (1. - guii)*ndindj);
+		}
+	}
+	}
+	}
+}
+
+void meas_fft_work_alloc(const struct params *const restrict p,
+		struct meas_fft_work *const w)
+{
+	const int n = 2*p->N*(p->period_uneqlt > 0 ? p->L : 1);
+	w->a = my_calloc(n * sizeof(num));
+	w->b = my_calloc(n * sizeof(num));
+	w->c = my_calloc(n * sizeof(num));
+}
+
+void meas_fft_work_free(struct meas_fft_work *const w)
+{
+	my_free(w->c);
+	my_free(w->b);
+	my_free(w->a);
+}
+
 void measure_eqlt(const struct params *const restrict p, const num phase,
 		const num *const restrict gu,
 		const num *const restrict gd,
+		struct meas_fft_work *const restrict fw,
 		struct meas_eqlt *const restrict m)
 {
 	m->n_sample++;
@@ -44,7 +123,22 @@ void measure_eqlt(const struct params *const restrict p, const num phase,
 		m->double_occ[r] += pre*(1. - guii)*(1. - gdii);
 	}
 
-	// 2 site measurements
+	// 2 site measurements, directly if the FFT fails
+	int fft = p->meas_fft;
+	if (fft) {
+		num *const restrict a = fw->a;
+		num *const restrict c = fw->c;
+		for (int i = 0; i < N; i++) {
+			a[i] = 2. - gu[i + i*N] - gd[i + i*N];
+			a[i + N] = gd[i + i*N] - gu[i + i*N];
+		}
+		fft = (fftm_corr(p->Nx, p->Ny, 2, a, a, c) == 0);
+	}
+	if (fft)
+		meas_2site_fft(p, phase / N, 1, gu, gu, gu, gu, gd, gd, gd, gd,
+		               fw->c, fw->c + N, m->g00, m->nn, m->xx, m->zz,
+		               m->pair_sw, meas_energy_corr ? m->vv : NULL, m->vn);
+	else
 	for (int j = 0; j < N; j++)
 	for (int i = 0; i < N; i++) {
 		const int delta = (i == j);
@@ -135,6 +229,7 @@ void measure_eqlt(const struct params *const restrict p, const num phase,
 		const num pdi1i0 = p->peierlsd[i1 + N*i0];
 #endif
 		const int bb = p->map_bb[b + c*num_b];
+		if (bb < 0) continue; // folded by C4v symmetry
 		const num pre = phase / p->degen_bb[bb];
 		const int delta_i0j0 = (i0 == j0);
 		const int delta_i1j0 = (i1 == j0);
@@ -174,6 +269,51 @@ void measure_eqlt(const struct params *const restrict p, const num phase,
 	}
 }
 
+// the 2 site measurements of measure_uneqlt() and measure_uneqlt_full() for
+// meas_fft. the density and moment convolutions of all t in one batch:
+// blocks 0..L-1 for n, L..2L-1 for s. returns -1, with m untouched, if the
+// FFT fails
+static int meas_uneqlt_2site_fft(const struct params *const restrict p,
+		const num phase,
+		const num *const Gu0t, const num *const Gutt, const num *const Gut0,
+		const num *const Gd0t, const num *const Gdtt, const num *const Gdt0,
+		struct meas_fft_work *const restrict fw,
+		struct meas_uneqlt *const restrict m)
+{
+	const int N = p->N, L = p->L, num_ij = p->num_ij;
+	const int meas_energy_corr = p->meas_energy_corr;
+	const num *const restrict Gu00 = Gutt;
+	const num *const restrict Gd00 = Gdtt;
+
+	num *const restrict a = fw->a;
+	num *const restrict b = fw->b;
+	num *const restrict c = fw->c;
+	for (int t = 0; t < L; t++)
+	for (int i = 0; i < N; i++) {
+		const num guii = Gutt[i + N*i + N*N*t], gdii = Gdtt[i + N*i + N*N*t];
+		const num gujj = Gu00[i + N*i], gdjj = Gd00[i + N*i];
+		a[i + N*t] = 2. - guii - gdii;
+		a[i + N*(t + L)] = gdii - guii;
+		b[i + N*t] = 2. - gujj - gdjj;
+		b[i + N*(t + L)] = gdjj - gujj;
+	}
+	if (fftm_corr(p->Nx, p->Ny, 2*L, a, b, c) < 0)
+		return -1;
+
+	#pragma omp parallel for
+	for (int t = 0; t < L; t++)
+		meas_2site_fft(p, phase / N, (t == 0),
+		               Gutt + N*N*t, Gut0 + N*N*t, Gu0t + N*N*t, Gu00,
+		               Gdtt + N*N*t, Gdt0 + N*N*t, Gd0t + N*N*t, Gd00,
+		               c + N*t, c + N*(t + L),
+		               m->gt0 + num_ij*t, m->nn + num_ij*t,
+		               m->xx + num_ij*t, m->zz + num_ij*t,
+		               m->pair_sw + num_ij*t,
+		               meas_energy_corr ? m->vv + num_ij*t : NULL,
+		               meas_energy_corr ? m->vn + num_ij*t : NULL);
+	return 0;
+}
+
 void measure_uneqlt(const struct params *const restrict p, const num phase,
 		const num *const Gu0t,
 		const num *const Gutt,
@@ -181,6 +321,7 @@ void measure_uneqlt(const struct params *const restrict p, const num phase,
 		const num *const Gd0t,
 		const num *const Gdtt,
 		const num *const Gdt0,
+		struct meas_fft_work *const restrict fw,
 		struct meas_uneqlt *const restrict m)
 {
 	m->n_sample++;
@@ -194,7 +335,10 @@ void measure_uneqlt(const struct params *const restrict p, const num phase,
 	const num *const restrict Gu00 = Gutt;
 	const num *const restrict Gd00 = Gdtt;
 
-	// 2 site measurements
+	// 2 site measurements, directly if the FFT fails
+	if (!p->meas_fft ||
+	    meas_uneqlt_2site_fft(p, phase, Gu0t, Gutt, Gut0,
+	                          Gd0t, Gdtt, Gdt0, fw, m) < 0)
 	#pragma omp parallel for
 	for (int t = 0; t < L; t++) {
 		const int delta_t = (t == 0);
@@ -311,6 +455,7 @@ void measure_uneqlt(const struct params *const restrict p, const num phase,
 		const num pdi1i0 = p->peierlsd[i1 + N*i0];
 #endif
 		const int bb = p->map_bb[b + c*num_b];
+		if (bb < 0) continue; // folded by C4v symmetry
 		const num pre = phase / p->degen_bb[bb];
 		const int delta_i0j0 = (i0 == j0);
 		const int delta_i1j0 = (i1 == j0);
@@ -376,6 +521,7 @@ void measure_uneqlt(const struct params *const restrict p, const num phase,
 		const num pdi1i0 = p->peierlsd[i1 + N*i0];
 #endif
 		const int bb = p->map_bb[b + c*num_b];
+		if (bb < 0) continue; // folded by C4v symmetry
 		const num pre = phase / p->degen_bb[bb];
 		const int delta_i0j0 = (i0 == j0);
 		const int delta_i1j0 = (i1 == j0);
@@ -472,6 +618,7 @@ void measure_uneqlt(const struct params *const restrict p, const num phase,
 		const num pdi1i0 = p->peierlsd[i1 + N*i0];
 #endif
 		const int bb = p->map_bb[b + c*num_b];
+		if (bb < 0) continue; // folded by C4v symmetry
 		const num pre = phase / p->degen_bb[bb];
 		const num gui0i0 = Gutt_t[i0 + i0*N];
 		const num gui1i0 = Gutt_t[i1 + i0*N];
@@ -538,6 +685,7 @@ void measure_uneqlt(const struct params *const restrict p, const num phase,
 		const int i0 = p->bonds[b];
 		const int i1 = p->bonds[b + num_b];
 		const int bb = p->map_bb[b + c*num_b];
+		if (bb < 0) continue; // folded by C4v symmetry
 		const num pre = phase / p->degen_bb[bb];
 		const num gui0i0 = Gutt_t[i0 + i0*N];
 		const num gui1i0 = Gutt_t[i1 + i0*N];
@@ -606,10 +754,328 @@ void measure_uneqlt(const struct params *const restrict p, const num phase,
 	}
 }
 
+// three-current correlator, factorized into two-bond intermediates. bond b1
+// (sites i0, i1) is at time t, b2 (k0, k1) at tau = t + dt and c (j0, j1)
+// at 0. per spin, the terms with one G between each pair of bonds are
+// traces of products of 2 x 2 matrices over the bond ends,
+// tr(R P Q) and tr(V W U), the others products of currents J and of the
+// two-bond sums IJ, KJ, KI. all of these are filled once per (t, tau), so
+// the loop over bond triples only multiplies them together
+struct jjj_spin {
+	num *Ji, *Jk, *Jj;    // G[b0, b1] - G[b1, b0] at t, tau, 0 (num_b)
+	num *R, *V;           // (c, b1), 2 x 2 each, (4*num_b*num_b)
+	num *Q, *W;           // (b2, c)
+	num *P, *U;           // (b2, b1)
+};
+
+struct jjj_work {
+	struct jjj_spin u, d;
+	num *IJ, *KJ, *KI;    // summed over spins, with the currents
+	num *meas;            // the correlator for the b2 in b2s
+	int *b2s;             // (num_b)
+	num *jjj, *jjj_l;     // this thread's share of m->jjj, m->jjj_l
+};
+
+static void jjj_spin_alloc(const int num_b, struct jjj_spin *const s)
+{
+	s->Ji = my_calloc(num_b * sizeof(num));
+	s->Jk = my_calloc(num_b * sizeof(num));
+	s->Jj = my_calloc(num_b * sizeof(num));
+	s->R = my_calloc(4*num_b*num_b * sizeof(num));
+	s->V = my_calloc(4*num_b*num_b * sizeof(num));
+	s->Q = my_calloc(4*num_b*num_b * sizeof(num));
+	s->W = my_calloc(4*num_b*num_b * sizeof(num));
+	s->P = my_calloc(4*num_b*num_b * sizeof(num));
+	s->U = my_calloc(4*num_b*num_b * sizeof(num));
+}
+
+static void jjj_spin_free(struct jjj_spin *const s)
+{
+	my_free(s->U);
+	my_free(s->P);
+	my_free(s->W);
+	my_free(s->Q);
+	my_free(s->V);
+	my_free(s->R);
+	my_free(s->Jj);
+	my_free(s->Jk);
+	my_free(s->Ji);
+}
+
+// currents on all bonds from the equal-time G
+static void jjj_current(const int N, const int num_b, const int *const restrict bonds,
+		const num *const restrict G, num *const restrict J)
+{
+	for (int b = 0; b < num_b; b++) {
+		const int x0 = bonds[b], x1 = bonds[b + num_b];
+		J[b] = G[x0 + N*x1] - G[x1 + N*x0];
+	}
+}
+
+// for bonds a (a0, a1) and b (b0, b1): h[x + 2*y] = delta (b_x == a_y) -
+// Gba[b_x, a_y] and g[x + 2*y] = Gab[a_x, b_y]. returns the exchange term of
+// the two-bond sum, the part of ij_s, kj_s, ki_s without the currents
+static num jjj_pair(const int N, const int a0, const int a1, const int b0,
+		const int b1, const int delta, const num *const restrict Gab,
+		const num *const restrict Gba, num *const restrict h,
+		num *const restrict g)
+{
+	const int a[2] = {a0, a1}, b[2] = {b0, b1};
+	for (int y = 0; y < 2; y++)
+	for (int x = 0; x < 2; x++) {
+		h[x + 2*y] = delta*(b[x] == a[y]) - Gba[b[x] + N*a[y]];
+		g[x + 2*y] = Gab[a[x] + N*b[y]];
+	}
+	return h[1]*g[1] - h[0]*g[3] + h[2]*g[2] - h[3]*g[0];
+}
+
+// tr(A B C) for 2 x 2 A, B, C
+static inline num tr3(const num *const restrict A, const num *const restrict B,
+		const num *const restrict C)
+{
+	num s = 0.0;
+	for (int i = 0; i < 2; i++)
+	for (int j = 0; j < 2; j++)
+		s += A[i + 2*j]*(B[j]*C[2*i] + B[j + 2]*C[1 + 2*i]);
+	return s;
+}
+
+static void jjj_work_alloc(const int num_b, const int n_jjj,
+		const int n_jjj_l, struct jjj_work *const w)
+{
+	jjj_spin_alloc(num_b, &w->u);
+	jjj_spin_alloc(num_b, &w->d);
+	w->IJ = my_calloc(num_b*num_b * sizeof(num));
+	w->KJ = my_calloc(num_b*num_b * sizeof(num));
+	w->KI = my_calloc(num_b*num_b * sizeof(num));
+	w->meas = my_calloc(num_b * sizeof(num));
+	w->b2s = my_calloc(num_b * sizeof(int));
+	w->jjj = n_jjj > 0 ? my_calloc(n_jjj * sizeof(num)) : NULL;
+	w->jjj_l = n_jjj_l > 0 ? my_calloc(n_jjj_l * sizeof(num)) : NULL;
+}
+
+static void jjj_work_free(struct jjj_work *const w)
+{
+	if (w->jjj_l != NULL) my_free(w->jjj_l);
+	if (w->jjj != NULL) my_free(w->jjj);
+	my_free(w->b2s);
+	my_free(w->meas);
+	my_free(w->KI);
+	my_free(w->KJ);
+	my_free(w->IJ);
+	jjj_spin_free(&w->d);
+	jjj_spin_free(&w->u);
+}
+
+// the 2 x 2 factors from h and g of jjj_pair, for the pairs ij, kj, ki
+static inline void jjj_rv(const num *const restrict h, const num *const restrict g,
+		num *const restrict R, num *const restrict V)
+{
+	for (int y = 0; y < 2; y++)
+	for (int x = 0; x < 2; x++) {
+		R[x + 2*y] = h[!x + 2*!y];
+		V[x + 2*y] = y ? -g[!x + 2*y] : g[!x + 2*y];
+	}
+}
+
+static inline void jjj_qw(const num *const restrict h, const num *const restrict g,
+		num *const restrict Q, num *const restrict W)
+{
+	for (int y = 0; y < 2; y++)
+	for (int x = 0; x < 2; x++) {
+		Q[x + 2*y] = y ? -g[!x + 2*y] : g[!x + 2*y];
+		W[x + 2*y] = h[!x + 2*y];
+	}
+}
+
+static inline void jjj_pu(const num *const restrict h, const num *const restrict g,
+		num *const restrict P, num *const restrict U)
+{
+	for (int y = 0; y < 2; y++)
+	for (int x = 0; x < 2; x++) {
+		P[x + 2*y] = (x == y) ? -h[x + 2*y] : h[x + 2*y];
+		U[x + 2*y] = (x == y) ? g[!x + 2*y] : -g[!x + 2*y];
+	}
+}
+
+// the factors of one spin with i at t and j at 0: Gtt = G(t, t),
+// Gt0 = G(t, 0), G0t = G(0, t). adds to IJ
+static void jjj_fill_t(const struct params *const restrict p, const int delta_t,
+		const num *const restrict Gtt, const num *const restrict Gt0,
+		const num *const restrict G0t, const num *const restrict G00,
+		struct jjj_spin *const s, num *const restrict IJ)
+{
+	const int N = p->N, num_b = p->num_b;
+	const int *const restrict bonds = p->bonds;
+	jjj_current(N, num_b, bonds, Gtt, s->Ji);
+	jjj_current(N, num_b, bonds, G00, s->Jj);
+	for (int b1 = 0; b1 < num_b; b1++)
+	for (int c = 0; c < num_b; c++) {
+		const int o = c + num_b*b1;
+		num h[4], g[4];
+		IJ[o] += s->Ji[b1]*s->Jj[c] +
+		         jjj_pair(N, bonds[b1], bonds[b1 + num_b], bonds[c],
+		                  bonds[c + num_b], delta_t, Gt0, G0t, h, g);
+		jjj_rv(h, g, s->R + 4*o, s->V + 4*o);
+	}
+}
+
+// the factors of one spin with k at tau = t + dt: Gkk = G(tau, tau),
+// Gk0 = G(tau, 0), G0k = G(0, tau), Gkt = G(tau, t), Gtk = G(t, tau).
+// adds to KJ and KI
+static void jjj_fill_tau(const struct params *const restrict p,
+		const int delta_dt, const int delta_tau,
+		const num *const restrict Gkk, const num *const restrict Gk0,
+		const num *const restrict G0k, const num *const restrict Gkt,
+		const num *const restrict Gtk, struct jjj_spin *const s,
+		num *const restrict KJ, num *const restrict KI)
+{
+	const int N = p->N, num_b = p->num_b;
+	const int *const restrict bonds = p->bonds;
+	jjj_current(N, num_b, bonds, Gkk, s->Jk);
+	for (int c = 0; c < num_b; c++)
+	for (int b2 = 0; b2 < num_b; b2++) {
+		const int o = b2 + num_b*c;
+		num h[4], g[4];
+		KJ[o] += s->Jk[b2]*s->Jj[c] +
+		         jjj_pair(N, bonds[b2], bonds[b2 + num_b], bonds[c],
+		                  bonds[c + num_b], delta_tau, Gk0, G0k, h, g);
+		jjj_qw(h, g, s->Q + 4*o, s->W + 4*o);
+	}
+	for (int b1 = 0; b1 < num_b; b1++)
+	for (int b2 = 0; b2 < num_b; b2++) {
+		const int o = b2 + num_b*b1;
+		num h[4], g[4];
+		KI[o] += s->Jk[b2]*s->Ji[b1] +
+		         jjj_pair(N, bonds[b2], bonds[b2 + num_b], bonds[b1],
+		                  bonds[b1 + num_b], delta_dt, Gkt, Gtk, h, g);
+		jjj_pu(h, g, s->P + 4*o, s->U + 4*o);
+	}
+}
+
+// the correlator for bonds b1, c and b2 = w->b2s[0 .. n-1] in w->meas
+static void jjj_row(const int num_b, const struct jjj_work *const w,
+		const int b1, const int c, const int n)
+{
+	const struct jjj_spin *const u = &w->u, *const d = &w->d;
+	const int o = c + num_b*b1;
+	const num jjiu = u->Ji[b1]*u->Jj[c], jjid = d->Ji[b1]*d->Jj[c];
+	const num ji = u->Ji[b1] + d->Ji[b1], jj = u->Jj[c] + d->Jj[c];
+	const num ij = w->IJ[o];
+	const num *const restrict KJ = w->KJ + num_b*c;
+	const num *const restrict KI = w->KI + num_b*b1;
+	const num *const restrict Ru = u->R + 4*o, *const restrict Rd = d->R + 4*o;
+	const num *const restrict Vu = u->V + 4*o, *const restrict Vd = d->V + 4*o;
+	const num *const restrict Pu = u->P + 4*num_b*b1, *const restrict Pd = d->P + 4*num_b*b1;
+	const num *const restrict Uu = u->U + 4*num_b*b1, *const restrict Ud = d->U + 4*num_b*b1;
+	const num *const restrict Qu = u->Q + 4*num_b*c, *const restrict Qd = d->Q + 4*num_b*c;
+	const num *const restrict Wu = u->W + 4*num_b*c, *const restrict Wd = d->W + 4*num_b*c;
+	const int *const restrict b2s = w->b2s;
+	num *const restrict meas = w->meas;
+	for (int i = 0; i < n; i++) {
+		const int b2 = b2s[i];
+		const num part1 = (u->Jk[b2] + d->Jk[b2])*ij + ji*KJ[b2] + jj*KI[b2];
+		const num part2u = tr3(Ru, Pu + 4*b2, Qu + 4*b2);
+		const num part2d = tr3(Rd, Pd + 4*b2, Qd + 4*b2);
+		const num part3u = tr3(Vu, Wu + 4*b2, Uu + 4*b2);
+		const num part3d = tr3(Vd, Wd + 4*b2, Ud + 4*b2);
+		meas[i] = -2*(u->Jk[b2]*jjiu + d->Jk[b2]*jjid) + part1
+		           - part2u - part2d + part3u + part3d;
+	}
+}
+
+// the G blocks of one spin with i at t, k at tau = t + dt and j at 0
+struct jjj_g {
+	const num *Gtt, *Gt0, *G0t, *G00;
+	const num *Gkk, *Gk0, *G0k, *Gkt, *Gtk;
+};
+
+// one spin's part of the correlator for the single triple b1, b2, c, as
+// jjj_fill_t and jjj_fill_tau: currents J = (Ji, Jk, Jj), exchange terms X
+// of (IJ, KJ, KI) and the traces tr = (tr(R P Q), tr(V W U))
+static void jjj_triple_spin(const struct params *const restrict p,
+		const int b1, const int b2, const int c,
+		const int delta_t, const int delta_dt, const struct jjj_g *const G,
+		num *const restrict J, num *const restrict X, num *const restrict tr)
+{
+	const int N = p->N, num_b = p->num_b;
+	const int *const restrict bonds = p->bonds;
+	const int i0 = bonds[b1], i1 = bonds[b1 + num_b];
+	const int k0 = bonds[b2], k1 = bonds[b2 + num_b];
+	const int j0 = bonds[c], j1 = bonds[c + num_b];
+	num h[4], g[4], R[4], V[4], Q[4], W[4], P[4], U[4];
+	J[0] = G->Gtt[i0 + N*i1] - G->Gtt[i1 + N*i0];
+	J[1] = G->Gkk[k0 + N*k1] - G->Gkk[k1 + N*k0];
+	J[2] = G->G00[j0 + N*j1] - G->G00[j1 + N*j0];
+	X[0] = jjj_pair(N, i0, i1, j0, j1, delta_t, G->Gt0, G->G0t, h, g);
+	jjj_rv(h, g, R, V);
+	X[1] = jjj_pair(N, k0, k1, j0, j1, delta_t*delta_dt, G->Gk0, G->G0k, h, g);
+	jjj_qw(h, g, Q, W);
+	X[2] = jjj_pair(N, k0, k1, i0, i1, delta_dt, G->Gkt, G->Gtk, h, g);
+	jjj_pu(h, g, P, U);
+	tr[0] = tr3(R, P, Q);
+	tr[1] = tr3(V, W, U);
+}
+
+// the correlator for the single triple b1, b2, c, as jjj_row
+static num jjj_triple(const struct params *const restrict p,
+		const int b1, const int b2, const int c,
+		const int delta_t, const int delta_dt,
+		const struct jjj_g *const gu, const struct jjj_g *const gd)
+{
+	num Ju[3], Jd[3], Xu[3], Xd[3], tru[2], trd[2];
+	jjj_triple_spin(p, b1, b2, c, delta_t, delta_dt, gu, Ju, Xu, tru);
+	jjj_triple_spin(p, b1, b2, c, delta_t, delta_dt, gd, Jd, Xd, trd);
+	const num ij = Ju[0]*Ju[2] + Xu[0] + Jd[0]*Jd[2] + Xd[0];
+	const num kj = Ju[1]*Ju[2] + Xu[1] + Jd[1]*Jd[2] + Xd[1];
+	const num ki = Ju[1]*Ju[0] + Xu[2] + Jd[1]*Jd[0] + Xd[2];
+	return -2*(Ju[1]*Ju[0]*Ju[2] + Jd[1]*Jd[0]*Jd[2])
+	       + (Ju[1] + Jd[1])*ij + (Ju[0] + Jd[0])*kj + (Ju[2] + Jd[2])*ki
+	       - tru[0] - trd[0] + tru[1] + trd[1];
+}
+
+// size of one thread's share of work->G_rc
+#define G_RC_SIZE(N, L) (4*(N)*(N)*(L) + 2*(N)*(N))
+
+void ue_full_work_alloc(const struct params *const restrict p,
+		const int n_thread, struct ue_full_work *const w)
+{
+	const int N = p->N, L = p->L;
+	w->n_thread = n_thread;
+	w->Gu0t = my_calloc(N*N*L * sizeof(num));
+	w->Gutt = my_calloc(N*N*L * sizeof(num));
+	w->Gut0 = my_calloc(N*N*L * sizeof(num));
+	w->Gd0t = my_calloc(N*N*L * sizeof(num));
+	w->Gdtt = my_calloc(N*N*L * sizeof(num));
+	w->Gdt0 = my_calloc(N*N*L * sizeof(num));
+	w->G_rc = my_calloc(n_thread*G_RC_SIZE(N, L) * sizeof(num));
+	w->ws = my_calloc(n_thread * sizeof(struct jjj_work));
+	for (int th = 0; th < n_thread; th++)
+		jjj_work_alloc(p->num_b, p->meas_3curr ? p->num_bbb*L : 0,
+		               p->meas_3curr_limit ? p->num_bbb_lim*L : 0,
+		               w->ws + th);
+}
+
+void ue_full_work_free(struct ue_full_work *const w)
+{
+	for (int th = w->n_thread - 1; th >= 0; th--)
+		jjj_work_free(w->ws + th);
+	my_free(w->ws);
+	my_free(w->G_rc);
+	my_free(w->Gdt0);
+	my_free(w->Gdtt);
+	my_free(w->Gd0t);
+	my_free(w->Gut0);
+	my_free(w->Gutt);
+	my_free(w->Gu0t);
+}
 
 void measure_uneqlt_full(const struct params *const restrict p, const num phase,
-		const num *const Gu,
-		const num *const Gd,
+		const struct ue_g *const ueu,
+		const struct ue_g *const ued,
+		struct ue_full_work *const restrict work,
+		struct meas_fft_work *const restrict fw,
+		uint64_t *const restrict rng,
 		struct meas_uneqlt *const restrict m)
 {
 	m->n_sample++;
@@ -623,19 +1089,49 @@ void measure_uneqlt_full(const struct params *const restrict p, const num phase,
         const int meas_3curr_limit = p-> meas_3curr_limit;
 
 
-	const num *const restrict Gu00 = Gu;
-	const num *const restrict Gd00 = Gd;
+	// G(0, t), G(t, t) and G(t, 0) for all t. the 3-current measurements
+	// also need G(t, t') and G(t', t), which are generated one row and
+	// column at a time
+	num *const restrict Gu0t = work->Gu0t;
+	num *const restrict Gutt = work->Gutt;
+	num *const restrict Gut0 = work->Gut0;
+	num *const restrict Gd0t = work->Gd0t;
+	num *const restrict Gdtt = work->Gdtt;
+	num *const restrict Gdt0 = work->Gdt0;
+	#pragma omp parallel sections num_threads(work->n_thread)
+	{
+	#pragma omp section
+	{
+	num *const restrict tmp = work->G_rc + G_RC_SIZE(N, L)*omp_get_thread_num() + 4*N*N*L;
+	ue_g_row(ueu, 0, Gu0t, tmp);
+	ue_g_diag(ueu, Gutt, tmp);
+	ue_g_col(ueu, 0, Gut0, tmp);
+	}
+	#pragma omp section
+	{
+	num *const restrict tmp = work->G_rc + G_RC_SIZE(N, L)*omp_get_thread_num() + 4*N*N*L;
+	ue_g_row(ued, 0, Gd0t, tmp);
+	ue_g_diag(ued, Gdtt, tmp);
+	ue_g_col(ued, 0, Gdt0, tmp);
+	}
+	}
 
-	// 2 site measurements
+	const num *const restrict Gu00 = Gutt;
+	const num *const restrict Gd00 = Gdtt;
+
+	// 2 site measurements, directly if the FFT fails
+	if (!p->meas_fft ||
+	    meas_uneqlt_2site_fft(p, phase, Gu0t, Gutt, Gut0,
+	                          Gd0t, Gdtt, Gdt0, fw, m) < 0)
 	#pragma omp parallel for
 	for (int t = 0; t < L; t++) {
 		const int delta_t = (t == 0);
-		const num *const restrict Gu0t_t = Gu + N*N*(0+L*t);
-		const num *const restrict Gutt_t = Gu + N*N*(t+L*t);
-		const num *const restrict Gut0_t = Gu + N*N*(t+L*0);
-		const num *const restrict Gd0t_t = Gd + N*N*(0+L*t);
-		const num *const restrict Gdtt_t = Gd + N*N*(t+L*t);
-		const num *const restrict Gdt0_t = Gd + N*N*(t+L*0);
+		const num *const restrict Gu0t_t = Gu0t + N*N*t;
+		const num *const restrict Gutt_t = Gutt + N*N*t;
+		const num *const restrict Gut0_t = Gut0 + N*N*t;
+		const num *const restrict Gd0t_t = Gd0t + N*N*t;
+		const num *const restrict Gdtt_t = Gdtt + N*N*t;
+		const num *const restrict Gdt0_t = Gdt0 + N*N*t;
 	for (int j = 0; j < N; j++)
 	for (int i = 0; i < N; i++) {
 		const int r = p->map_ij[i + j*N];
@@ -673,12 +1169,12 @@ void measure_uneqlt_full(const struct params *const restrict p, const num phase,
 	#pragma omp parallel for
 	for (int t = 0; t < L; t++) {
 		const int delta_t = (t == 0);
-		const num *const restrict Gu0t_t = Gu + N*N*(0+L*t);
-		const num *const restrict Gutt_t = Gu + N*N*(t+L*t);
-		const num *const restrict Gut0_t = Gu + N*N*(t+L*0);
-		const num *const restrict Gd0t_t = Gd + N*N*(0+L*t);
-		const num *const restrict Gdtt_t = Gd + N*N*(t+L*t);
-		const num *const restrict Gdt0_t = Gd + N*N*(t+L*0);
+		const num *const restrict Gu0t_t = Gu0t + N*N*t;
+		const num *const restrict Gutt_t = Gutt + N*N*t;
+		const num *const restrict Gut0_t = Gut0 + N*N*t;
+		const num *const restrict Gd0t_t = Gd0t + N*N*t;
+		const num *const restrict Gdtt_t = Gdtt + N*N*t;
+		const num *const restrict Gdt0_t = Gdt0 + N*N*t;
 	for (int j = 0; j < N; j++)
 	for (int b = 0; b < num_b; b++) {
 		const int i0 = p->bonds[b];
@@ -743,6 +1239,7 @@ void measure_uneqlt_full(const struct params *const restrict p, const num phase,
 		const num pdi1i0 = p->peierlsd[i1 + N*i0];
 #endif
 		const int bb = p->map_bb[b + c*num_b];
+		if (bb < 0) continue; // folded by C4v symmetry
 		const num pre = phase / p->degen_bb[bb];
 		const int delta_i0j0 = (i0 == j0);
 		const int delta_i1j0 = (i1 == j0);
@@ -808,6 +1305,7 @@ void measure_uneqlt_full(const struct params *const restrict p, const num phase,
 		const num pdi1i0 = p->peierlsd[i1 + N*i0];
 #endif
 		const int bb = p->map_bb[b + c*num_b];
+		if (bb < 0) continue; // folded by C4v symmetry
 		const num pre = phase / p->degen_bb[bb];
 		const int delta_i0j0 = (i0 == j0);
 		const int delta_i1j0 = (i1 == j0);
@@ -878,12 +1376,12 @@ void measure_uneqlt_full(const struct params *const restrict p, const num phase,
 	if (meas_bond_corr)
 	#pragma omp parallel for
 	for (int t = 1; t < L; t++) {
-		const num *const restrict Gu0t_t = Gu + N*N*(0+L*t);
-		const num *const restrict Gutt_t = Gu + N*N*(t+L*t);
-		const num *const restrict Gut0_t = Gu + N*N*(t+L*0);
-		const num *const restrict Gd0t_t = Gd + N*N*(0+L*t);
-		const num *const restrict Gdtt_t = Gd + N*N*(t+L*t);
-		const num *const restrict Gdt0_t = Gd + N*N*(t+L*0);
+		const num *const restrict Gu0t_t = Gu0t + N*N*t;
+		const num *const restrict Gutt_t = Gutt + N*N*t;
+		const num *const restrict Gut0_t = Gut0 + N*N*t;
+		const num *const restrict Gd0t_t = Gd0t + N*N*t;
+		const num *const restrict Gdtt_t = Gdtt + N*N*t;
+		const num *const restrict Gdt0_t = Gdt0 + N*N*t;
 	for (int c = 0; c < num_b; c++) {
 		const int j0 = p->bonds[c];
 		const int j1 = p->bonds[c + num_b];
@@ -903,6 +1401,7 @@ void measure_uneqlt_full(const struct params *const restrict p, const num phase,
 		const num pdi1i0 = p->peierlsd[i1 + N*i0];
 #endif
 		const int bb = p->map_bb[b + c*num_b];
+		if (bb < 0) continue; // folded by C4v symmetry
 		const num pre = phase / p->degen_bb[bb];
 		const num gui0i0 = Gutt_t[i0 + i0*N];
 		const num gui1i0 = Gutt_t[i1 + i0*N];
@@ -953,407 +1452,171 @@ void measure_uneqlt_full(const struct params *const restrict p, const num phase,
 	}
 	}
 
-        if (meas_3curr)
-	#pragma omp parallel for
+	// 3-current correlators for all bond triples (meas_3curr) and for those
+	// in map_bbb_lim (meas_3curr_limit), from the factors of jjj_row. each
+	// (t, dt) adds to both times t and t + dt, so every thread accumulates
+	// into its own copy and the copies are summed in thread order at the end.
+	// with jjj_n_sample > 0, jjj is estimated from that many triples drawn
+	// uniformly (with replacement) per measurement instead, each weighted by
+	// num_b^3/jjj_n_sample so the estimate stays unbiased
+	if (meas_3curr || meas_3curr_limit) {
+	const int n_sample = meas_3curr ? p->jjj_n_sample : 0;
+	const int jjj_full = meas_3curr && n_sample == 0;
+	const int jjj_exact = jjj_full || meas_3curr_limit;
+	const int num_bbbb = num_b*num_b*num_b;
+	const num weight = n_sample > 0 ? (double)num_bbbb/n_sample : 0.0;
+	int *const jjj_s = n_sample > 0 ? my_calloc(n_sample * sizeof(int)) : NULL;
+	for (int s = 0; s < n_sample; s++) {
+		jjj_s[s] = (rand_uint(rng) >> 3) % num_bbbb;
+		// triples folded away by c4v have no class of their own
+		if (p->map_bbb[jjj_s[s]] >= 0)
+			m->jjj_n[p->map_bbb[jjj_s[s]]]++;
+	}
+	const struct jjj_work *const ws = work->ws;
+	#pragma omp parallel num_threads(work->n_thread)
+	{
+	const int n_thread = omp_get_num_threads();
+	num *const restrict Gu_row = work->G_rc + G_RC_SIZE(N, L)*omp_get_thread_num();
+	num *const restrict Gu_col = Gu_row + N*N*L;
+	num *const restrict Gd_row = Gu_col + N*N*L;
+	num *const restrict Gd_col = Gd_row + N*N*L;
+	num *const restrict tmp = Gd_col + N*N*L;
+	struct jjj_work *const w = work->ws + omp_get_thread_num();
+	if (meas_3curr)
+		for (int i = 0; i < num_bbb*L; i++) w->jjj[i] = 0.0;
+	if (meas_3curr_limit)
+		for (int i = 0; i < num_bbb_lim*L; i++) w->jjj_l[i] = 0.0;
+	#pragma omp for schedule(static, 1)
 	for (int t = 0; t < L; t++) {
-		num factor1 = 1.0;
-		num factor2 = 1.0;
-                num factor3 = 1.0;
-                const int delta_t = (t == 0);
-		const num *const restrict Gu0t_t = Gu + N*N*(0+L*t);
-		const num *const restrict Gutt_t = Gu + N*N*(t+L*t);
-		const num *const restrict Gut0_t = Gu + N*N*(t+L*0);
-		const num *const restrict Gd0t_t = Gd + N*N*(0+L*t);
-		const num *const restrict Gdtt_t = Gd + N*N*(t+L*t);
-		const num *const restrict Gdt0_t = Gd + N*N*(t+L*0);
-        for (int dt = 0; (t+dt) < L; dt++) {
-		const num *const restrict Gu0t_dt = Gu + N*N*(t+L*(dt+t));
-		const num *const restrict Gutt_dt = Gu + N*N*(dt+t+L*(dt+t));
-		const num *const restrict Gut0_dt = Gu + N*N*(dt+t+L*t);
-		const num *const restrict Gd0t_dt = Gd + N*N*(t+L*(dt+t));
-		const num *const restrict Gdtt_dt = Gd + N*N*(dt+t+L*(dt+t));
-		const num *const restrict Gdt0_dt = Gd + N*N*(dt+t+L*t);
-                const int delta_dt = (dt == 0);
-                const num *const restrict Gu0t_tdt = Gu + N*N*(0+L*(t+dt));
-		const num *const restrict Gutt_tdt = Gu + N*N*(t+dt+L*(t+dt));
-		const num *const restrict Gut0_tdt = Gu + N*N*(t+dt+L*0);
-		const num *const restrict Gd0t_tdt = Gd + N*N*(0+L*(t+dt));
-		const num *const restrict Gdtt_tdt = Gd + N*N*(t+dt+L*(t+dt));
-		const num *const restrict Gdt0_tdt = Gd + N*N*(t+dt+L*0);
-                const int delta_tdt = delta_t*delta_dt;
-	for (int c = 0; c < num_b; c++) {
-		const int j0 = p->bonds[c];
-		const int j1 = p->bonds[c + num_b];
+		ue_g_row(ueu, t, Gu_row, tmp);
+		ue_g_col(ueu, t, Gu_col, tmp);
+		ue_g_row(ued, t, Gd_row, tmp);
+		ue_g_col(ued, t, Gd_col, tmp);
+		const int delta_t = (t == 0);
+		if (jjj_exact) {
+		for (int o = 0; o < num_b*num_b; o++) w->IJ[o] = 0.0;
+		jjj_fill_t(p, delta_t, Gutt + N*N*t, Gut0 + N*N*t, Gu0t + N*N*t,
+		           Gu00, &w->u, w->IJ);
+		jjj_fill_t(p, delta_t, Gdtt + N*N*t, Gdt0 + N*N*t, Gd0t + N*N*t,
+		           Gd00, &w->d, w->IJ);
+		}
+	for (int dt = 0; (t+dt) < L; dt++) {
+		const int delta_dt = (dt == 0);
+		const int delta_tdt = delta_t*delta_dt;
+		const int tau = t + dt;
+		const num factor1 = p->integral_kernel[(t+dt)*(L+2) + t];
+		const num factor2 = p->integral_kernel[     t*(L+2) + (t+1+dt)];
+		const num factor3 = p->integral_kernel[(t+dt)*(L+2) + (L+1)];
+		if (n_sample > 0) {
+		const struct jjj_g gu = {Gutt + N*N*t, Gut0 + N*N*t, Gu0t + N*N*t, Gu00,
+			Gutt + N*N*tau, Gut0 + N*N*tau, Gu0t + N*N*tau,
+			Gu_col + N*N*tau, Gu_row + N*N*tau};
+		const struct jjj_g gd = {Gdtt + N*N*t, Gdt0 + N*N*t, Gd0t + N*N*t, Gd00,
+			Gdtt + N*N*tau, Gdt0 + N*N*tau, Gd0t + N*N*tau,
+			Gd_col + N*N*tau, Gd_row + N*N*tau};
+		for (int s = 0; s < n_sample; s++) {
+			const int b2 = jjj_s[s] % num_b;
+			const int b1 = (jjj_s[s] / num_b) % num_b;
+			const int c = jjj_s[s] / (num_b*num_b);
+			const int bbb1 = p->map_bbb[b2 + b1*num_b + c*num_b*num_b];
+			const int bbb2 = p->map_bbb[b1 + b2*num_b + c*num_b*num_b];
+			const int bbb3 = p->map_bbb[b2 + c*num_b + b1*num_b*num_b];
+			if (bbb1 == -1 && bbb2 == -1 && (t != 0 || bbb3 == -1))
+				continue;
+			const num meas = weight*jjj_triple(p, b1, b2, c, delta_t,
+			                                   delta_dt, &gu, &gd);
+			if (bbb1 != -1)
+				w->jjj[bbb1 + num_bbb*(t+dt)] += phase / p->degen_bbb[bbb1]*meas*factor1;
+			if (bbb2 != -1)
+				w->jjj[bbb2 + num_bbb*t] += phase / p->degen_bbb[bbb2]*meas*factor2;
+			if (t == 0 && bbb3 != -1)
+				w->jjj[bbb3 + num_bbb*(t+dt)] += phase / p->degen_bbb[bbb3]*meas*factor3;
+		}
+		}
+		if (!jjj_exact) continue;
+		for (int o = 0; o < num_b*num_b; o++) w->KJ[o] = w->KI[o] = 0.0;
+		jjj_fill_tau(p, delta_dt, delta_tdt, Gutt + N*N*tau, Gut0 + N*N*tau,
+		             Gu0t + N*N*tau, Gu_col + N*N*tau, Gu_row + N*N*tau,
+		             &w->u, w->KJ, w->KI);
+		jjj_fill_tau(p, delta_dt, delta_tdt, Gdtt + N*N*tau, Gdt0 + N*N*tau,
+		             Gd0t + N*N*tau, Gd_col + N*N*tau, Gd_row + N*N*tau,
+		             &w->d, w->KJ, w->KI);
+	for (int c = 0; c < num_b; c++)
 	for (int b1 = 0; b1 < num_b; b1++) {
-		const int i0 = p->bonds[b1];
-		const int i1 = p->bonds[b1 + num_b];
-        for (int b2 = 0; b2 < num_b; b2++) {
-		const int k0 = p->bonds[b2];
-		const int k1 = p->bonds[b2 + num_b];
-                
-		const int bbb1 = p->map_bbb[b2 + b1*num_b + c*num_b*num_b];
-                const int bbb2 = p->map_bbb[b1 + b2*num_b + c*num_b*num_b];
-		const int bbb3 = p->map_bbb[b2 + c*num_b + b1*num_b*num_b];
-		const num pre1 = phase / p->degen_bbb[bbb1];
-                const num pre2 = phase / p->degen_bbb[bbb2];
-		const num pre3 = phase / p->degen_bbb[bbb3];
-		const int delta_i0k0 = (i0 == k0)*delta_dt;
-		const int delta_i1k0 = (i1 == k0)*delta_dt;
-		const int delta_i0k1 = (i0 == k1)*delta_dt;
-		const int delta_i1k1 = (i1 == k1)*delta_dt;
-		
-                const int delta_i0j0 = (j0 == i0)*delta_t;
-		const int delta_i0j1 = (j1 == i0)*delta_t;
-		const int delta_i1j0 = (j0 == i1)*delta_t;
-		const int delta_i1j1 = (j1 == i1)*delta_t;
-                
-                const int delta_j0k0 = (k0 == j0)*delta_tdt;
-		const int delta_j0k1 = (k1 == j0)*delta_tdt;
-		const int delta_j1k0 = (k0 == j1)*delta_tdt;
-		const int delta_j1k1 = (k1 == j1)*delta_tdt;
-                
-		const num gui0i0 = Gutt_t[i0 + i0*N];
-		const num gui1i0 = Gutt_t[i1 + i0*N];
-		const num gui0i1 = Gutt_t[i0 + i1*N];
-		const num gui1i1 = Gutt_t[i1 + i1*N];
-		const num gui0j0 = Gut0_t[i0 + j0*N];
-		const num gui1j0 = Gut0_t[i1 + j0*N];
-		const num gui0j1 = Gut0_t[i0 + j1*N];
-		const num gui1j1 = Gut0_t[i1 + j1*N];
-		const num guj0i0 = Gu0t_t[j0 + i0*N];
-		const num guj1i0 = Gu0t_t[j1 + i0*N];
-		const num guj0i1 = Gu0t_t[j0 + i1*N];
-		const num guj1i1 = Gu0t_t[j1 + i1*N];
-		const num guj0j0 = Gu00[j0 + j0*N];
-		const num guj1j0 = Gu00[j1 + j0*N];
-		const num guj0j1 = Gu00[j0 + j1*N];
-		const num guj1j1 = Gu00[j1 + j1*N];
-		const num gdi0i0 = Gdtt_t[i0 + i0*N];
-		const num gdi1i0 = Gdtt_t[i1 + i0*N];
-		const num gdi0i1 = Gdtt_t[i0 + i1*N];
-		const num gdi1i1 = Gdtt_t[i1 + i1*N];
-		const num gdi0j0 = Gdt0_t[i0 + j0*N];
-		const num gdi1j0 = Gdt0_t[i1 + j0*N];
-		const num gdi0j1 = Gdt0_t[i0 + j1*N];
-		const num gdi1j1 = Gdt0_t[i1 + j1*N];
-		const num gdj0i0 = Gd0t_t[j0 + i0*N];
-		const num gdj1i0 = Gd0t_t[j1 + i0*N];
-		const num gdj0i1 = Gd0t_t[j0 + i1*N];
-		const num gdj1i1 = Gd0t_t[j1 + i1*N];
-		const num gdj0j0 = Gd00[j0 + j0*N];
-		const num gdj1j0 = Gd00[j1 + j0*N];
-		const num gdj0j1 = Gd00[j0 + j1*N];
-		const num gdj1j1 = Gd00[j1 + j1*N];
-                                           
-                const num guk0k0 = Gutt_tdt[k0 + k0*N];
-		const num guk1k0 = Gutt_tdt[k1 + k0*N];
-		const num guk0k1 = Gutt_tdt[k0 + k1*N];
-		const num guk1k1 = Gutt_tdt[k1 + k1*N];
-		const num guk0j0 = Gut0_tdt[k0 + j0*N];
-		const num guk1j0 = Gut0_tdt[k1 + j0*N];
-		const num guk0j1 = Gut0_tdt[k0 + j1*N];
-		const num guk1j1 = Gut0_tdt[k1 + j1*N];
-		const num guj0k0 = Gu0t_tdt[j0 + k0*N];
-		const num guj1k0 = Gu0t_tdt[j1 + k0*N];
-		const num guj0k1 = Gu0t_tdt[j0 + k1*N];
-		const num guj1k1 = Gu0t_tdt[j1 + k1*N];
-		const num gdk0k0 = Gdtt_tdt[k0 + k0*N];
-		const num gdk1k0 = Gdtt_tdt[k1 + k0*N];
-		const num gdk0k1 = Gdtt_tdt[k0 + k1*N];
-		const num gdk1k1 = Gdtt_tdt[k1 + k1*N];
-		const num gdk0j0 = Gdt0_tdt[k0 + j0*N];
-		const num gdk1j0 = Gdt0_tdt[k1 + j0*N];
-		const num gdk0j1 = Gdt0_tdt[k0 + j1*N];
-		const num gdk1j1 = Gdt0_tdt[k1 + j1*N];
-		const num gdj0k0 = Gd0t_tdt[j0 + k0*N];
-		const num gdj1k0 = Gd0t_tdt[j1 + k0*N];
-		const num gdj0k1 = Gd0t_tdt[j0 + k1*N];
-		const num gdj1k1 = Gd0t_tdt[j1 + k1*N];
-
-		const num guk0i0 = Gut0_dt[k0 + i0*N];
-		const num guk1i0 = Gut0_dt[k1 + i0*N];
-		const num guk0i1 = Gut0_dt[k0 + i1*N];
-		const num guk1i1 = Gut0_dt[k1 + i1*N];
-		const num gui0k0 = Gu0t_dt[i0 + k0*N];
-		const num gui1k0 = Gu0t_dt[i1 + k0*N];
-		const num gui0k1 = Gu0t_dt[i0 + k1*N];
-		const num gui1k1 = Gu0t_dt[i1 + k1*N];
-		const num gdk0i0 = Gdt0_dt[k0 + i0*N];
-		const num gdk1i0 = Gdt0_dt[k1 + i0*N];
-		const num gdk0i1 = Gdt0_dt[k0 + i1*N];
-		const num gdk1i1 = Gdt0_dt[k1 + i1*N];
-		const num gdi0k0 = Gd0t_dt[i0 + k0*N];
-		const num gdi1k0 = Gd0t_dt[i1 + k0*N];
-		const num gdi0k1 = Gd0t_dt[i0 + k1*N];
-		const num gdi1k1 = Gd0t_dt[i1 + k1*N];
-
-		const num jku =  (guk0k1-guk1k0);
-                const num jkd =  (gdk0k1-gdk1k0);
-                const num jiu =  (gui0i1-gui1i0);
-                const num jid =  (gdi0i1-gdi1i0);
-                const num jju =  (guj0j1-guj1j0);
-                const num jjd =  (gdj0j1-gdj1j0);
-
-                const num jjju = jku*jiu*jju;
-                const num jjjd = jkd*jid*jjd;
-
-                const num ij_u = (gui1i0-gui0i1)*(guj1j0-guj0j1) + (delta_i0j1-guj1i0)*gui1j0 - (delta_i0j0-guj0i0)*gui1j1 + (delta_i1j0-guj0i1)*gui0j1 - (delta_i1j1-guj1i1)*gui0j0;
-                const num ij_d = (gdi1i0-gdi0i1)*(gdj1j0-gdj0j1) + (delta_i0j1-gdj1i0)*gdi1j0 - (delta_i0j0-gdj0i0)*gdi1j1 + (delta_i1j0-gdj0i1)*gdi0j1 - (delta_i1j1-gdj1i1)*gdi0j0;
-                const num kj_u = (guk1k0-guk0k1)*(guj1j0-guj0j1) + (delta_j1k0-guj1k0)*guk1j0 - (delta_j0k0-guj0k0)*guk1j1 + (delta_j0k1-guj0k1)*guk0j1 - (delta_j1k1-guj1k1)*guk0j0;
-                const num kj_d = (gdk1k0-gdk0k1)*(gdj1j0-gdj0j1) + (delta_j1k0-gdj1k0)*gdk1j0 - (delta_j0k0-gdj0k0)*gdk1j1 + (delta_j0k1-gdj0k1)*gdk0j1 - (delta_j1k1-gdj1k1)*gdk0j0;
-                const num ki_u = (guk1k0-guk0k1)*(gui1i0-gui0i1) + (delta_i1k0-gui1k0)*guk1i0 - (delta_i0k0-gui0k0)*guk1i1 + (delta_i0k1-gui0k1)*guk0i1 - (delta_i1k1-gui1k1)*guk0i0;
-                const num ki_d = (gdk1k0-gdk0k1)*(gdi1i0-gdi0i1) + (delta_i1k0-gdi1k0)*gdk1i0 - (delta_i0k0-gdi0k0)*gdk1i1 + (delta_i0k1-gdi0k1)*gdk0i1 - (delta_i1k1-gdi1k1)*gdk0i0;
-                const num part1 = (jku+jkd)*(ij_u+ij_d)+(jiu+jid)*(kj_u+kj_d)+(jju+jjd)*(ki_u+ki_d);
-
-                const num part2u = (delta_i1k0-gui1k0)*guk1j0*(delta_i0j1-guj1i0) - (delta_i1k1-gui1k1)*guk0j0*(delta_i0j1-guj1i0) 
-                                  -(delta_i0k0-gui0k0)*guk1j0*(delta_i1j1-guj1i1) - (delta_i1k0-gui1k0)*guk1j1*(delta_i0j0-guj0i0) 
-                                  +(delta_i0k1-gui0k1)*guk0j0*(delta_i1j1-guj1i1) + (delta_i1k1-gui1k1)*guk0j1*(delta_i0j0-guj0i0) 
-                                  +(delta_i0k0-gui0k0)*guk1j1*(delta_i1j0-guj0i1) - (delta_i0k1-gui0k1)*guk0j1*(delta_i1j0-guj0i1);
-
-                const num part2d = (delta_i1k0-gdi1k0)*gdk1j0*(delta_i0j1-gdj1i0) - (delta_i1k1-gdi1k1)*gdk0j0*(delta_i0j1-gdj1i0) 
-                                  -(delta_i0k0-gdi0k0)*gdk1j0*(delta_i1j1-gdj1i1) - (delta_i1k0-gdi1k0)*gdk1j1*(delta_i0j0-gdj0i0) 
-                                  +(delta_i0k1-gdi0k1)*gdk0j0*(delta_i1j1-gdj1i1) + (delta_i1k1-gdi1k1)*gdk0j1*(delta_i0j0-gdj0i0) 
-                                  +(delta_i0k0-gdi0k0)*gdk1j1*(delta_i1j0-gdj0i1) - (delta_i0k1-gdi0k1)*gdk0j1*(delta_i1j0-gdj0i1);
-
-                const num part3u = guk1i0*gui1j0*(delta_j1k0-guj1k0) - guk0i0*gui1j0*(delta_j1k1-guj1k1) - guk1i1*gui0j0*(delta_j1k0-guj1k0) 
-                                 - guk1i0*gui1j1*(delta_j0k0-guj0k0) + guk0i1*gui0j0*(delta_j1k1-guj1k1) + guk0i0*gui1j1*(delta_j0k1-guj0k1) 
-                                 + guk1i1*gui0j1*(delta_j0k0-guj0k0) - guk0i1*gui0j1*(delta_j0k1-guj0k1);
-
-                const num part3d = gdk1i0*gdi1j0*(delta_j1k0-gdj1k0) - gdk0i0*gdi1j0*(delta_j1k1-gdj1k1) - gdk1i1*gdi0j0*(delta_j1k0-gdj1k0) 
-                                 - gdk1i0*gdi1j1*(delta_j0k0-gdj0k0) + gdk0i1*gdi0j0*(delta_j1k1-gdj1k1) + gdk0i0*gdi1j1*(delta_j0k1-gdj0k1) 
-                                 + gdk1i1*gdi0j1*(delta_j0k0-gdj0k0) - gdk0i1*gdi0j1*(delta_j0k1-gdj0k1);
-		const num meas=-2*jjju -2*jjjd +part1 -part2u -part2d +part3u +part3d;
-                factor1 = p->integral_kernel[(t+dt)*(L+2) + t]; 
-                factor2 = p->integral_kernel[     t*(L+2) + (t+1+dt)]; 
-                factor3 = p->integral_kernel[(t+dt)*(L+2) + (L+1)];
-                //printf("%f\t%f\t%f\t%f\t%f\t%f\n", pre1, pre2, pre3, meas, factor1, factor2);
-                m->jjj[bbb1 + num_bbb*(t+dt)] += pre1*meas*factor1;
-                m->jjj[bbb2 + num_bbb*t] += pre2*meas*factor2;
-                if (t==0)
-                m->jjj[bbb3 + num_bbb*(t+dt)] += pre3*meas*factor3;
-        }
-        }
+		const int *const restrict map_bbb = p->map_bbb;
+		const int *const restrict map_bbb_lim = p->map_bbb_lim;
+		// the b2 in a triple of interest: those of map_bbb not folded by
+		// C4v symmetry (-1), and those of map_bbb_lim. bbb3 is only for t = 0
+		int n_b2 = 0;
+		for (int b2 = 0; b2 < num_b; b2++) {
+			const int x1 = b2 + b1*num_b + c*num_b*num_b;
+			const int x2 = b1 + b2*num_b + c*num_b*num_b;
+			const int x3 = b2 + c*num_b + b1*num_b*num_b;
+			if ((jjj_full && (map_bbb[x1] != -1 || map_bbb[x2] != -1 ||
+			                  (t == 0 && map_bbb[x3] != -1))) ||
+			    (meas_3curr_limit && (map_bbb_lim[x1] != -1 || map_bbb_lim[x2] != -1 ||
+			                          (t == 0 && map_bbb_lim[x3] != -1))))
+				w->b2s[n_b2++] = b2;
+		}
+		if (n_b2 == 0) continue;
+		jjj_row(num_b, w, b1, c, n_b2);
+		if (jjj_full)
+		for (int i = 0; i < n_b2; i++) {
+			const int b2 = w->b2s[i];
+			const int bbb1 = map_bbb[b2 + b1*num_b + c*num_b*num_b];
+			const int bbb2 = map_bbb[b1 + b2*num_b + c*num_b*num_b];
+			const int bbb3 = map_bbb[b2 + c*num_b + b1*num_b*num_b];
+			const num meas = w->meas[i];
+			if (bbb1 != -1)
+				w->jjj[bbb1 + num_bbb*(t+dt)] += phase / p->degen_bbb[bbb1]*meas*factor1;
+			if (bbb2 != -1)
+				w->jjj[bbb2 + num_bbb*t] += phase / p->degen_bbb[bbb2]*meas*factor2;
+			if (t == 0 && bbb3 != -1)
+				w->jjj[bbb3 + num_bbb*(t+dt)] += phase / p->degen_bbb[bbb3]*meas*factor3;
+		}
+		// This is only for none-tp case.
+		// If consider tp and want to improve the speed by removing some measurements, please use a mark matrix to rule out the specific measurements.
+		// It is also a good idea to just use the original 3-current measurments since the "unnecessary" measurements may be used in the future.
+		if (meas_3curr_limit)
+		for (int i = 0; i < n_b2; i++) {
+			const int b2 = w->b2s[i];
+			const int bbb1 = map_bbb_lim[b2 + b1*num_b + c*num_b*num_b];
+			const int bbb2 = map_bbb_lim[b1 + b2*num_b + c*num_b*num_b];
+			const int bbb3 = map_bbb_lim[b2 + c*num_b + b1*num_b*num_b];
+			const num meas = w->meas[i];
+			if (bbb1 != -1)
+				w->jjj_l[bbb1 + num_bbb_lim*(t+dt)] += phase / p->degen_bbb_lim[bbb1]*meas*factor1;
+			if (bbb2 != -1)
+				w->jjj_l[bbb2 + num_bbb_lim*t] += phase / p->degen_bbb_lim[bbb2]*meas*factor2;
+			if (t == 0 && bbb3 != -1)
+				w->jjj_l[bbb3 + num_bbb_lim*(t+dt)] += phase / p->degen_bbb_lim[bbb3]*meas*factor3;
+		}
 	}
 	}
-        }
-        
-        // This is only for none-tp case.
-        // If consider tp and want to improve the speed by removing some measurements, please use a mark matrix to rule out the specific measurements.
-        // It is also a good idea to just use the original 3-current measurments since the "unnecessary" measurements may be used in the future.
-        if (meas_3curr_limit)
-	#pragma omp parallel for
-	for (int t = 0; t < L; t++) {
-                num factor1 = 1.0;
-		num factor2 = 1.0;
-                num factor3 = 1.0;
-                const int delta_t = (t == 0);
-		const num *const restrict Gu0t_t = Gu + N*N*(0+L*t);
-		const num *const restrict Gutt_t = Gu + N*N*(t+L*t);
-		const num *const restrict Gut0_t = Gu + N*N*(t+L*0);
-		const num *const restrict Gd0t_t = Gd + N*N*(0+L*t);
-		const num *const restrict Gdtt_t = Gd + N*N*(t+L*t);
-		const num *const restrict Gdt0_t = Gd + N*N*(t+L*0);
-        for (int dt = 0; (t+dt) < L; dt++) {
-		const num *const restrict Gu0t_dt = Gu + N*N*(t+L*(dt+t));
-		const num *const restrict Gutt_dt = Gu + N*N*(dt+t+L*(dt+t));
-		const num *const restrict Gut0_dt = Gu + N*N*(dt+t+L*t);
-		const num *const restrict Gd0t_dt = Gd + N*N*(t+L*(dt+t));
-		const num *const restrict Gdtt_dt = Gd + N*N*(dt+t+L*(dt+t));
-		const num *const restrict Gdt0_dt = Gd + N*N*(dt+t+L*t);
-                const int delta_dt = (dt == 0);
-                const num *const restrict Gu0t_tdt = Gu + N*N*(0+L*(t+dt));
-		const num *const restrict Gutt_tdt = Gu + N*N*(t+dt+L*(t+dt));
-		const num *const restrict Gut0_tdt = Gu + N*N*(t+dt+L*0);
-		const num *const restrict Gd0t_tdt = Gd + N*N*(0+L*(t+dt));
-		const num *const restrict Gdtt_tdt = Gd + N*N*(t+dt+L*(t+dt));
-		const num *const restrict Gdt0_tdt = Gd + N*N*(t+dt+L*0);
-                const int delta_tdt = delta_t*delta_dt;
-	for (int c = 0; c < num_b; c++) {
-		const int j0 = p->bonds[c];
-		const int j1 = p->bonds[c + num_b];
-	for (int b1 = 0; b1 < num_b; b1++) {
-		const int i0 = p->bonds[b1];
-		const int i1 = p->bonds[b1 + num_b];
-        for (int b2 = 0; b2 < num_b; b2++) {
-		const int k0 = p->bonds[b2];
-		const int k1 = p->bonds[b2 + num_b];
-                
-		const int bbb1 = p->map_bbb_lim[b2 + b1*num_b + c*num_b*num_b];
-                const int bbb2 = p->map_bbb_lim[b1 + b2*num_b + c*num_b*num_b];
-		const int bbb3 = p->map_bbb_lim[b2 + c*num_b + b1*num_b*num_b];
-                // If none of the bondbondbond types is of interest, don't measure
-                if ((bbb1 == -1) && (bbb2 == -1) && (bbb3 == -1)){
-                    continue;}
-                // This condition is because bbb3 is only for the internal integral at tau'=beta
-                // even if the bond bbb3 is of interest, we don't measure the unnecessary time difference types of correlations
-                // we only want t==0 for bbb3 != -1
-                if ((bbb1 == -1) && (bbb2 == -1) && (bbb3 != -1) && (t!=0)){
-                    continue;}
-                
-                num pre1=0.0;
-                num pre2=0.0;
-                num pre3=0.0; 
-		if (bbb1 != -1){
-                    pre1 = phase / p->degen_bbb_lim[bbb1];}
-                if (bbb2 != -1){
-                    pre2 = phase / p->degen_bbb_lim[bbb2];}
-                if (bbb3 != -1){
-		    pre3 = phase / p->degen_bbb_lim[bbb3];}
-                
-		const int delta_i0k0 = (i0 == k0)*delta_dt;
-		const int delta_i1k0 = (i1 == k0)*delta_dt;
-		const int delta_i0k1 = (i0 == k1)*delta_dt;
-		const int delta_i1k1 = (i1 == k1)*delta_dt;
-		
-                const int delta_i0j0 = (j0 == i0)*delta_t;
-		const int delta_i0j1 = (j1 == i0)*delta_t;
-		const int delta_i1j0 = (j0 == i1)*delta_t;
-		const int delta_i1j1 = (j1 == i1)*delta_t;
-                
-                const int delta_j0k0 = (k0 == j0)*delta_tdt;
-		const int delta_j0k1 = (k1 == j0)*delta_tdt;
-		const int delta_j1k0 = (k0 == j1)*delta_tdt;
-		const int delta_j1k1 = (k1 == j1)*delta_tdt;
-                
-		const num gui0i0 = Gutt_t[i0 + i0*N];
-		const num gui1i0 = Gutt_t[i1 + i0*N];
-		const num gui0i1 = Gutt_t[i0 + i1*N];
-		const num gui1i1 = Gutt_t[i1 + i1*N];
-		const num gui0j0 = Gut0_t[i0 + j0*N];
-		const num gui1j0 = Gut0_t[i1 + j0*N];
-		const num gui0j1 = Gut0_t[i0 + j1*N];
-		const num gui1j1 = Gut0_t[i1 + j1*N];
-		const num guj0i0 = Gu0t_t[j0 + i0*N];
-		const num guj1i0 = Gu0t_t[j1 + i0*N];
-		const num guj0i1 = Gu0t_t[j0 + i1*N];
-		const num guj1i1 = Gu0t_t[j1 + i1*N];
-		const num guj0j0 = Gu00[j0 + j0*N];
-		const num guj1j0 = Gu00[j1 + j0*N];
-		const num guj0j1 = Gu00[j0 + j1*N];
-		const num guj1j1 = Gu00[j1 + j1*N];
-		const num gdi0i0 = Gdtt_t[i0 + i0*N];
-		const num gdi1i0 = Gdtt_t[i1 + i0*N];
-		const num gdi0i1 = Gdtt_t[i0 + i1*N];
-		const num gdi1i1 = Gdtt_t[i1 + i1*N];
-		const num gdi0j0 = Gdt0_t[i0 + j0*N];
-		const num gdi1j0 = Gdt0_t[i1 + j0*N];
-		const num gdi0j1 = Gdt0_t[i0 + j1*N];
-		const num gdi1j1 = Gdt0_t[i1 + j1*N];
-		const num gdj0i0 = Gd0t_t[j0 + i0*N];
-		const num gdj1i0 = Gd0t_t[j1 + i0*N];
-		const num gdj0i1 = Gd0t_t[j0 + i1*N];
-		const num gdj1i1 = Gd0t_t[j1 + i1*N];
-		const num gdj0j0 = Gd00[j0 + j0*N];
-		const num gdj1j0 = Gd00[j1 + j0*N];
-		const num gdj0j1 = Gd00[j0 + j1*N];
-		const num gdj1j1 = Gd00[j1 + j1*N];
-                                           
-                const num guk0k0 = Gutt_tdt[k0 + k0*N];
-		const num guk1k0 = Gutt_tdt[k1 + k0*N];
-		const num guk0k1 = Gutt_tdt[k0 + k1*N];
-		const num guk1k1 = Gutt_tdt[k1 + k1*N];
-		const num guk0j0 = Gut0_tdt[k0 + j0*N];
-		const num guk1j0 = Gut0_tdt[k1 + j0*N];
-		const num guk0j1 = Gut0_tdt[k0 + j1*N];
-		const num guk1j1 = Gut0_tdt[k1 + j1*N];
-		const num guj0k0 = Gu0t_tdt[j0 + k0*N];
-		const num guj1k0 = Gu0t_tdt[j1 + k0*N];
-		const num guj0k1 = Gu0t_tdt[j0 + k1*N];
-		const num guj1k1 = Gu0t_tdt[j1 + k1*N];
-		const num gdk0k0 = Gdtt_tdt[k0 + k0*N];
-		const num gdk1k0 = Gdtt_tdt[k1 + k0*N];
-		const num gdk0k1 = Gdtt_tdt[k0 + k1*N];
-		const num gdk1k1 = Gdtt_tdt[k1 + k1*N];
-		const num gdk0j0 = Gdt0_tdt[k0 + j0*N];
-		const num gdk1j0 = Gdt0_tdt[k1 + j0*N];
-		const num gdk0j1 = Gdt0_tdt[k0 + j1*N];
-		const num gdk1j1 = Gdt0_tdt[k1 + j1*N];
-		const num gdj0k0 = Gd0t_tdt[j0 + k0*N];
-		const num gdj1k0 = Gd0t_tdt[j1 + k0*N];
-		const num gdj0k1 = Gd0t_tdt[j0 + k1*N];
-		const num gdj1k1 = Gd0t_tdt[j1 + k1*N];
-
-		const num guk0i0 = Gut0_dt[k0 + i0*N];
-		const num guk1i0 = Gut0_dt[k1 + i0*N];
-		const num guk0i1 = Gut0_dt[k0 + i1*N];
-		const num guk1i1 = Gut0_dt[k1 + i1*N];
-		const num gui0k0 = Gu0t_dt[i0 + k0*N];
-		const num gui1k0 = Gu0t_dt[i1 + k0*N];
-		const num gui0k1 = Gu0t_dt[i0 + k1*N];
-		const num gui1k1 = Gu0t_dt[i1 + k1*N];
-		const num gdk0i0 = Gdt0_dt[k0 + i0*N];
-		const num gdk1i0 = Gdt0_dt[k1 + i0*N];
-		const num gdk0i1 = Gdt0_dt[k0 + i1*N];
-		const num gdk1i1 = Gdt0_dt[k1 + i1*N];
-		const num gdi0k0 = Gd0t_dt[i0 + k0*N];
-		const num gdi1k0 = Gd0t_dt[i1 + k0*N];
-		const num gdi0k1 = Gd0t_dt[i0 + k1*N];
-		const num gdi1k1 = Gd0t_dt[i1 + k1*N];
-
-                const num jku =  (guk0k1-guk1k0);
-                const num jkd =  (gdk0k1-gdk1k0);
-                const num jiu =  (gui0i1-gui1i0);
-                const num jid =  (gdi0i1-gdi1i0);
-                const num jju =  (guj0j1-guj1j0);
-                const num jjd =  (gdj0j1-gdj1j0);
-
-                const num jjju = jku*jiu*jju;
-                const num jjjd = jkd*jid*jjd;
-
-                const num ij_u = (gui1i0-gui0i1)*(guj1j0-guj0j1) + (delta_i0j1-guj1i0)*gui1j0 - (delta_i0j0-guj0i0)*gui1j1 + (delta_i1j0-guj0i1)*gui0j1 - (delta_i1j1-guj1i1)*gui0j0;
-                const num ij_d = (gdi1i0-gdi0i1)*(gdj1j0-gdj0j1) + (delta_i0j1-gdj1i0)*gdi1j0 - (delta_i0j0-gdj0i0)*gdi1j1 + (delta_i1j0-gdj0i1)*gdi0j1 - (delta_i1j1-gdj1i1)*gdi0j0;
-                const num kj_u = (guk1k0-guk0k1)*(guj1j0-guj0j1) + (delta_j1k0-guj1k0)*guk1j0 - (delta_j0k0-guj0k0)*guk1j1 + (delta_j0k1-guj0k1)*guk0j1 - (delta_j1k1-guj1k1)*guk0j0;
-                const num kj_d = (gdk1k0-gdk0k1)*(gdj1j0-gdj0j1) + (delta_j1k0-gdj1k0)*gdk1j0 - (delta_j0k0-gdj0k0)*gdk1j1 + (delta_j0k1-gdj0k1)*gdk0j1 - (delta_j1k1-gdj1k1)*gdk0j0;
-                const num ki_u = (guk1k0-guk0k1)*(gui1i0-gui0i1) + (delta_i1k0-gui1k0)*guk1i0 - (delta_i0k0-gui0k0)*guk1i1 + (delta_i0k1-gui0k1)*guk0i1 - (delta_i1k1-gui1k1)*guk0i0;
-                const num ki_d = (gdk1k0-gdk0k1)*(gdi1i0-gdi0i1) + (delta_i1k0-gdi1k0)*gdk1i0 - (delta_i0k0-gdi0k0)*gdk1i1 + (delta_i0k1-gdi0k1)*gdk0i1 - (delta_i1k1-gdi1k1)*gdk0i0;
-                const num part1 = (jku+jkd)*(ij_u+ij_d)+(jiu+jid)*(kj_u+kj_d)+(jju+jjd)*(ki_u+ki_d);
-
-                const num part2u = (delta_i1k0-gui1k0)*guk1j0*(delta_i0j1-guj1i0) - (delta_i1k1-gui1k1)*guk0j0*(delta_i0j1-guj1i0) 
-                                  -(delta_i0k0-gui0k0)*guk1j0*(delta_i1j1-guj1i1) - (delta_i1k0-gui1k0)*guk1j1*(delta_i0j0-guj0i0) 
-                                  +(delta_i0k1-gui0k1)*guk0j0*(delta_i1j1-guj1i1) + (delta_i1k1-gui1k1)*guk0j1*(delta_i0j0-guj0i0) 
-                                  +(delta_i0k0-gui0k0)*guk1j1*(delta_i1j0-guj0i1) - (delta_i0k1-gui0k1)*guk0j1*(delta_i1j0-guj0i1);
-
-                const num part2d = (delta_i1k0-gdi1k0)*gdk1j0*(delta_i0j1-gdj1i0) - (delta_i1k1-gdi1k1)*gdk0j0*(delta_i0j1-gdj1i0) 
-                                  -(delta_i0k0-gdi0k0)*gdk1j0*(delta_i1j1-gdj1i1) - (delta_i1k0-gdi1k0)*gdk1j1*(delta_i0j0-gdj0i0) 
-                                  +(delta_i0k1-gdi0k1)*gdk0j0*(delta_i1j1-gdj1i1) + (delta_i1k1-gdi1k1)*gdk0j1*(delta_i0j0-gdj0i0) 
-                                  +(delta_i0k0-gdi0k0)*gdk1j1*(delta_i1j0-gdj0i1) - (delta_i0k1-gdi0k1)*gdk0j1*(delta_i1j0-gdj0i1);
-
-                const num part3u = guk1i0*gui1j0*(delta_j1k0-guj1k0) - guk0i0*gui1j0*(delta_j1k1-guj1k1) - guk1i1*gui0j0*(delta_j1k0-guj1k0) 
-                                 - guk1i0*gui1j1*(delta_j0k0-guj0k0) + guk0i1*gui0j0*(delta_j1k1-guj1k1) + guk0i0*gui1j1*(delta_j0k1-guj0k1) 
-                                 + guk1i1*gui0j1*(delta_j0k0-guj0k0) - guk0i1*gui0j1*(delta_j0k1-guj0k1);
-
-                const num part3d = gdk1i0*gdi1j0*(delta_j1k0-gdj1k0) - gdk0i0*gdi1j0*(delta_j1k1-gdj1k1) - gdk1i1*gdi0j0*(delta_j1k0-gdj1k0) 
-                                 - gdk1i0*gdi1j1*(delta_j0k0-gdj0k0) + gdk0i1*gdi0j0*(delta_j1k1-gdj1k1) + gdk0i0*gdi1j1*(delta_j0k1-gdj0k1) 
-                                 + gdk1i1*gdi0j1*(delta_j0k0-gdj0k0) - gdk0i1*gdi0j1*(delta_j0k1-gdj0k1);
-		const num meas=-2*jjju -2*jjjd +part1 -part2u -part2d +part3u +part3d;
-                factor1 = p->integral_kernel[(t+dt)*(L+2) + t]; 
-                factor2 = p->integral_kernel[     t*(L+2) + (t+1+dt)]; 
-                factor3 = p->integral_kernel[(t+dt)*(L+2) + (L+1)];
-                // printf("%f\t%f\t%f\t%f\t%f\t%f\t%f\n", pre1, pre2, pre3, factor1, factor2, factor3);
-                if (bbb1 != -1){
-                    m->jjj_l[bbb1 + num_bbb_lim*(t+dt)] += pre1*meas*factor1;}
-                if (bbb2 != -1){
-                    m->jjj_l[bbb2 + num_bbb_lim*t] += pre2*meas*factor2;}
-                if ( (t==0) && (bbb3 != -1) ){
-                    m->jjj_l[bbb3 + num_bbb_lim*(t+dt)] += pre3*meas*factor3;}
-        }
-        }
 	}
+	if (meas_3curr)
+	#pragma omp for
+	for (int i = 0; i < num_bbb*L; i++)
+		for (int th = 0; th < n_thread; th++)
+			m->jjj[i] += ws[th].jjj[i];
+	if (meas_3curr_limit)
+	#pragma omp for
+	for (int i = 0; i < num_bbb_lim*L; i++)
+		for (int th = 0; th < n_thread; th++)
+			m->jjj_l[i] += ws[th].jjj_l[i];
+	}
+	if (jjj_s != NULL) my_free(jjj_s);
 	}
-        }
-
-
-
 
 	if (meas_nematic_corr)
 	#pragma omp parallel for
 	for (int t = 1; t < L; t++) {
-		const num *const restrict Gu0t_t = Gu + N*N*(0+L*t);
-		const num *const restrict Gutt_t = Gu + N*N*(t+L*t);
-		const num *const restrict Gut0_t = Gu + N*N*(t+L*0);
-		const num *const restrict Gd0t_t = Gd + N*N*(0+L*t);
-		const num *const restrict Gdtt_t = Gd + N*N*(t+L*t);
-		const num *const restrict Gdt0_t = Gd + N*N*(t+L*0);
+		const num *const restrict Gu0t_t = Gu0t + N*N*t;
+		const num *const restrict Gutt_t = Gutt + N*N*t;
+		const num *const restrict Gut0_t = Gut0 + N*N*t;
+		const num *const restrict Gd0t_t = Gd0t + N*N*t;
+		const num *const restrict Gdtt_t = Gdtt + N*N*t;
+		const num *const restrict Gdt0_t = Gdt0 + N*N*t;
 	for (int c = 0; c < NEM_BONDS*N; c++) {
 		const int j0 = p->bonds[c];
 		const int j1 = p->bonds[c + num_b];
@@ -1361,6 +1624,7 @@ void measure_uneqlt_full(const struct params *const restrict p, const num phase,
 		const int i0 = p->bonds[b];
 		const int i1 = p->bonds[b + num_b];
 		const int bb = p->map_bb[b + c*num_b];
+		if (bb < 0) continue; // folded by C4v symmetry
 		const num pre = phase / p->degen_bb[bb];
 		const num gui0i0 = Gutt_t[i0 + i0*N];
 		const num gui1i0 = Gutt_t[i1 + i0*N];
@@ -1,11 +1,26 @@
 #pragma once
 
 #include "data.h"
+#include "greens.h"
 #include "util.h"
 
+// work space of the meas_fft 2 site measurements, allocated once per run.
+// the equal-time ones use the first 2*N of a and c
+struct meas_fft_work {
+	num *a, *b, *c; // 2*N*L each, 2*N without unequal-time measurements
+};
+
+void meas_fft_work_alloc(const struct params *const restrict p,
+		struct meas_fft_work *const w);
+
+void meas_fft_work_free(struct meas_fft_work *const w);
+
+// with p->meas_fft, the 2 site measurements use fw, and fall back to the
+// direct sums if an FFT fails
 void measure_eqlt(const struct params *const restrict p, const num phase,
 		const num *const restrict gu,
 		const num *const restrict gd,
+		struct meas_fft_work *const restrict fw,
 		struct meas_eqlt *const restrict m);
 
 void measure_uneqlt(const struct params *const restrict p, const num phase,
@@ -15,9 +30,30 @@ void measure_uneqlt(const struct params *const restrict p, const num phase,
 		const num *const Gd0t,
 		const num *const Gdtt,
 		const num *const Gdt0,
+		struct meas_fft_work *const restrict fw,
 		struct meas_uneqlt *const restrict m);
 
+// work space of measure_uneqlt_full(), allocated once per run. the per thread
+// buffers are sized for n_thread threads
+struct jjj_work;
+struct ue_full_work {
+	int n_thread;
+	num *Gu0t, *Gutt, *Gut0, *Gd0t, *Gdtt, *Gdt0; // N*N*L each
+	num *G_rc;             // per thread G(t, .), G(., t) of both spins, and tmp
+	struct jjj_work *ws;   // per thread
+};
+
+void ue_full_work_alloc(const struct params *const restrict p,
+		const int n_thread, struct ue_full_work *const w);
+
+void ue_full_work_free(struct ue_full_work *const w);
+
+// the blocks of the unequal-time G are generated from ueu and ued as needed.
+// rng draws the bond triples of jjj if p->jjj_n_sample > 0
 void measure_uneqlt_full(const struct params *const restrict p, const num phase,
-		const num *const Gu,
-		const num *const Gd,
+		const struct ue_g *const ueu,
+		const struct ue_g *const ued,
+		struct ue_full_work *const restrict work,
+		struct meas_fft_work *const restrict fw,
+		uint64_t *const restrict rng,
 		struct meas_uneqlt *const restrict m);
@@ -2,8 +2,51 @@
 
 #include <stdint.h>
 
+// two generators share the 17 word state (/state/rng):
+// xorshift1024*: rng[0..15] state, rng[16] index (0..15)
+// philox4x32-10: rng[0..7] buffered output, rng[8] key, rng[9], rng[10]
+//                128 bit counter of the next block, rng[16] =
+//                RAND_PHILOX + number of buffered words used (0..8)
+#define RAND_PHILOX 0x100
+
+// http://www.thesalmons.org/john/random123/papers/random123sc11.pdf
+// one block of 4x32 bits for counter (lo, hi), returned as 2 words
+static inline void philox_block(const uint64_t key, const uint64_t lo,
+		const uint64_t hi, uint64_t *const out)
+{
+	uint32_t x0 = lo, x1 = lo >> 32, x2 = hi, x3 = hi >> 32;
+	uint32_t k0 = key, k1 = key >> 32;
+	for (int r = 0; r < 10; r++) {
+		const uint64_t p0 = UINT64_C(0xD2511F53) * x0;
+		const uint64_t p1 = UINT64_C(0xCD9E8D57) * x2;
+		x0 = (uint32_t)(p1 >> 32) ^ x1 ^ k0;
+		x1 = (uint32_t)p1;
+		x2 = (uint32_t)(p0 >> 32) ^ x3 ^ k1;
+		x3 = (uint32_t)p0;
+		k0 += UINT32_C(0x9E3779B9);
+		k1 += UINT32_C(0xBB67AE85);
+	}
+	out[0] = x0 | (uint64_t)x1 << 32;
+	out[1] = x2 | (uint64_t)x3 << 32;
+}
+
+// refill the 8 buffered words of the philox state, 4 blocks at a time
+static inline void philox_fill(uint64_t *rng)
+{
+	const uint64_t lo = rng[9], hi = rng[10];
+	for (int b = 0; b < 4; b++)
+		philox_block(rng[8], lo + b, hi + (lo + b < lo), rng + 2*b);
+	rng[9] = lo + 4;
+	rng[10] = hi + (lo + 4 < lo);
+	rng[16] = RAND_PHILOX;
+}
+
 // http://xoroshiro.di.unimi.it/xorshift1024star.c
 static inline uint64_t rand_uint(uint64_t *rng) {
+	if (rng[16] >= RAND_PHILOX) {
+		if (rng[16] == RAND_PHILOX + 8) philox_fill(rng);
+		return rng[rng[16]++ - RAND_PHILOX];
+	}
 	const uint64_t s0 = rng[rng[16]];
 	const int p = (rng[16] + 1) & 15;
 	rng[16] = p;
@@ -13,14 +56,40 @@ static inline uint64_t rand_uint(uint64_t *rng) {
 	return rng[p] * UINT64_C(1181783497276652981);
 }
 
-static inline double rand_doub(uint64_t *rng)
+static inline double rand_to_doub(const uint64_t x)
 {
 	const union { uint64_t i; double d; } u = {
-		.i = UINT64_C(0x3FF) << 52 | rand_uint(rng) >> 12
+		.i = UINT64_C(0x3FF) << 52 | x >> 12
 	};
 	return u.d - 1.0;
 }
 
+static inline double rand_doub(uint64_t *rng)
+{
+	return rand_to_doub(rand_uint(rng));
+}
+
+// n uniforms at once. for xorshift, the same as n calls of rand_doub. for
+// philox, (n + 1)/2 fresh blocks in one pass, bypassing the buffer
+static inline void rand_doub_n(uint64_t *rng, const int n, double *const u)
+{
+	if (rng[16] < RAND_PHILOX) {
+		for (int i = 0; i < n; i++)
+			u[i] = rand_doub(rng);
+		return;
+	}
+	const uint64_t lo = rng[9], hi = rng[10];
+	const int n_block = (n + 1)/2;
+	for (int b = 0; b < n_block; b++) {
+		uint64_t x[2];
+		philox_block(rng[8], lo + b, hi + (lo + b < lo), x);
+		u[2*b] = rand_to_doub(x[0]);
+		if (2*b + 1 < n) u[2*b + 1] = rand_to_doub(x[1]);
+	}
+	rng[9] = lo + n_block;
+	rng[10] = hi + (lo + n_block < lo);
+}
+
 // fisher-yates
 static inline void shuffle(uint64_t *rng, const int n, int *a)
 {
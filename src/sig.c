@@ -81,3 +81,8 @@ int sig_check_state(const int sweep, const int n_sweep_warm, const int n_sweep)
 	progress_flag = 0;
 	return retval;
 }
+
+int sig_stopped(void)
+{
+	return stop_flag != 0;
+}
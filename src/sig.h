@@ -6,3 +6,6 @@
 void sig_init(FILE *_log, const tick_t _wall_start, const tick_t _max_time);
 
 int sig_check_state(const int sweep, const int n_sweep_warm, const int n_sweep);
+
+// 1 if a stop was requested, for walkers that don't report progress
+int sig_stopped(void);
@@ -1,86 +1,211 @@
 #include "updates.h"
+#include <omp.h>
 #include <tgmath.h>
 #include "linalg.h"
-#include "rand.h"
 #include "util.h"
 
-void update_delayed(const int N, const int n_delay, const double *const restrict del,
+// the update functions are called by both threads of the spin team that sb
+// belongs to (or by one thread, with sb->n = 1). thread 0 updates spin up,
+// thread 1 spin down. both read the same uniforms and the same du[i], dd[i],
+// so they agree on every flip without communicating and only meet at the
+// spin barrier around each accepted one. gd == NULL (particle-hole
+// symmetry) leaves only spin up, with 1 - gd_ii = gu_ii
+#define SPIN_THREADS \
+	const int tid = omp_get_thread_num(); \
+	const int do_u = (tid == 0); \
+	const int do_d = gd != NULL && (tid == 1 || sb->n == 1)
+
+int update_delayed(const int N, const int n_delay, const double *const restrict del,
+		const int n_int, const int *const restrict int_sites,
 		const int *const restrict site_order,
-		uint64_t *const restrict rng, int *const restrict hs,
+		const double *const restrict u, int *const restrict hs,
 		num *const restrict gu, num *const restrict gd, num *const restrict phase,
+		int *const restrict flip,
 		num *const restrict au, num *const restrict bu, num *const restrict du,
-		num *const restrict ad, num *const restrict bd, num *const restrict dd)
+		num *const restrict ad, num *const restrict bd, num *const restrict dd,
+		struct spin_barrier *const sb)
 {
-	int k = 0;
-	for (int j = 0; j < N; j++) du[j] = gu[j + N*j];
-	for (int j = 0; j < N; j++) dd[j] = gd[j + N*j];
-	for (int ii = 0; ii < N; ii++) {
-		const int i = site_order[ii];
-		const double delu = del[i + N*hs[i]];
-		const double deld = del[i + N*!hs[i]];
+	SPIN_THREADS;
+	int k = 0, n_flip = 0, n_u = 0;
+	if (do_u) for (int j = 0; j < N; j++) du[j] = gu[j + N*j];
+	if (do_d) for (int j = 0; j < N; j++) dd[j] = gd[j + N*j];
+	spin_barrier_wait(sb);
+	for (int ii = 0; ii < n_int; ii++) {
+		const int c = site_order[ii];
+		const int i = int_sites[c];
+		const double delu = del[i + N*hs[c]];
+		const double deld = del[i + N*!hs[c]];
 		if (delu == 0.0 && deld == 0.0) continue;
 		const num ru = 1.0 + (1.0 - du[i]) * delu;
-		const num rd = 1.0 + (1.0 - dd[i]) * deld;
+		const num rd = 1.0 + (gd != NULL ? 1.0 - dd[i] : du[i]) * deld;
 		const num prob = ru * rd;
 		const double absprob = fabs(prob);
-		if (rand_doub(rng) < absprob) {
-			#pragma omp parallel sections
-			{
-			#pragma omp section
-			{
-			for (int j = 0; j < N; j++) au[j + N*k] = gu[j + N*i];
-			for (int j = 0; j < N; j++) bu[j + N*k] = gu[i + N*j];
-			xgemv("N", N, k, 1.0, au, N, bu + i,
-			      N, 1.0, au + N*k, 1);
-			xgemv("N", N, k, 1.0, bu, N, au + i,
-			      N, 1.0, bu + N*k, 1);
-			au[i + N*k] -= 1.0;
-			for (int j = 0; j < N; j++) au[j + N*k] *= delu/ru;
-			for (int j = 0; j < N; j++) du[j] += au[j + N*k] * bu[j + N*k];
+		if (u[n_u++] < absprob) {
+			// everyone has decided on site i before du, dd and hs[c] change
+			spin_barrier_wait(sb);
+			if (tid == 0) {
+				hs[c] = !hs[c];
+				if (flip != NULL) flip[n_flip] = c;
+				*phase *= prob/absprob;
 			}
-			#pragma omp section
-			{
-			for (int j = 0; j < N; j++) ad[j + N*k] = gd[j + N*i];
-			for (int j = 0; j < N; j++) bd[j + N*k] = gd[i + N*j];
-			xgemv("N", N, k, 1.0, ad, N, bd + i,
-			      N, 1.0, ad + N*k, 1);
-			xgemv("N", N, k, 1.0, bd, N, ad + i,
-			      N, 1.0, bd + N*k, 1);
-			ad[i + N*k] -= 1.0;
-			for (int j = 0; j < N; j++) ad[j + N*k] *= deld/rd;
-			for (int j = 0; j < N; j++) dd[j] += ad[j + N*k] * bd[j + N*k];
+			if (do_u) {
+				for (int j = 0; j < N; j++) au[j + N*k] = gu[j + N*i];
+				for (int j = 0; j < N; j++) bu[j + N*k] = gu[i + N*j];
+				xgemv("N", N, k, 1.0, au, N, bu + i,
+				      N, 1.0, au + N*k, 1);
+				xgemv("N", N, k, 1.0, bu, N, au + i,
+				      N, 1.0, bu + N*k, 1);
+				au[i + N*k] -= 1.0;
+				for (int j = 0; j < N; j++) au[j + N*k] *= delu/ru;
+				for (int j = 0; j < N; j++) du[j] += au[j + N*k] * bu[j + N*k];
 			}
+			if (do_d) {
+				for (int j = 0; j < N; j++) ad[j + N*k] = gd[j + N*i];
+				for (int j = 0; j < N; j++) bd[j + N*k] = gd[i + N*j];
+				xgemv("N", N, k, 1.0, ad, N, bd + i,
+				      N, 1.0, ad + N*k, 1);
+				xgemv("N", N, k, 1.0, bd, N, ad + i,
+				      N, 1.0, bd + N*k, 1);
+				ad[i + N*k] -= 1.0;
+				for (int j = 0; j < N; j++) ad[j + N*k] *= deld/rd;
+				for (int j = 0; j < N; j++) dd[j] += ad[j + N*k] * bd[j + N*k];
 			}
 			k++;
-			hs[i] = !hs[i];
-			*phase *= prob/absprob;
-		}
-		if (k == n_delay) {
-			k = 0;
-			#pragma omp parallel sections
-			{
-			#pragma omp section
-			{
-			xgemm("N", "T", N, N, n_delay, 1.0,
-			      au, N, bu, N, 1.0, gu, N);
-			for (int j = 0; j < N; j++) du[j] = gu[j + N*j];
-			}
-			#pragma omp section
-			{
-			xgemm("N", "T", N, N, n_delay, 1.0,
-			      ad, N, bd, N, 1.0, gd, N);
-			for (int j = 0; j < N; j++) dd[j] = gd[j + N*j];
-			}
+			n_flip++;
+			if (k == n_delay) {
+				k = 0;
+				if (do_u) {
+					xgemm("N", "T", N, N, n_delay, 1.0,
+					      au, N, bu, N, 1.0, gu, N);
+					for (int j = 0; j < N; j++) du[j] = gu[j + N*j];
+				}
+				if (do_d) {
+					xgemm("N", "T", N, N, n_delay, 1.0,
+					      ad, N, bd, N, 1.0, gd, N);
+					for (int j = 0; j < N; j++) dd[j] = gd[j + N*j];
+				}
 			}
+			spin_barrier_wait(sb);
 		}
 	}
-	#pragma omp parallel sections
-	{
-	#pragma omp section
-	xgemm("N", "T", N, N, k, 1.0, au, N, bu, N, 1.0, gu, N);
-	#pragma omp section
-	xgemm("N", "T", N, N, k, 1.0, ad, N, bd, N, 1.0, gd, N);
+	if (do_u) xgemm("N", "T", N, N, k, 1.0, au, N, bu, N, 1.0, gu, N);
+	if (do_d) xgemm("N", "T", N, N, k, 1.0, ad, N, bd, N, 1.0, gd, N);
+	spin_barrier_wait(sb);
+	return n_flip;
+}
+
+// columns and rows of g + a b^T at the m sites sites[S[0 .. m-1]]:
+// X[:, s] = column sites[S[s]], X[:, m + s] = row sites[S[s]]. work: m*k
+static void delayed_look_ahead(const int N, const int m, const int k,
+		const int *const restrict sites, const int *const restrict S,
+		const num *const restrict g,
+		const num *const restrict a, const num *const restrict b,
+		num *const restrict X, num *const restrict work)
+{
+	for (int s = 0; s < m; s++)
+		for (int j = 0; j < N; j++) X[j + N*s] = g[j + N*sites[S[s]]];
+	for (int s = 0; s < m; s++)
+		for (int j = 0; j < N; j++) X[j + N*(m + s)] = g[sites[S[s]] + N*j];
+	if (k == 0) return;
+	for (int j = 0; j < k; j++)
+		for (int s = 0; s < m; s++) work[s + m*j] = b[sites[S[s]] + N*j];
+	xgemm("N", "T", N, m, k, 1.0, a, N, work, m, 1.0, X, N);
+	for (int j = 0; j < k; j++)
+		for (int s = 0; s < m; s++) work[s + m*j] = a[sites[S[s]] + N*j];
+	xgemm("N", "T", N, m, k, 1.0, b, N, work, m, 1.0, X + N*m, N);
+}
+
+int update_delayed_rec(const int N, const int n_delay, const int n_inner,
+		const double *const restrict del,
+		const int n_int, const int *const restrict int_sites,
+		const int *const restrict site_order,
+		const double *const restrict u, int *const restrict hs,
+		num *const restrict gu, num *const restrict gd, num *const restrict phase,
+		int *const restrict flip,
+		num *const restrict au, num *const restrict bu, num *const restrict du,
+		num *const restrict xu, num *const restrict wu,
+		num *const restrict ad, num *const restrict bd, num *const restrict dd,
+		num *const restrict xd, num *const restrict wd,
+		struct spin_barrier *const sb)
+{
+	SPIN_THREADS;
+	int k = 0, n_flip = 0, n_u = 0;
+	if (do_u) for (int j = 0; j < N; j++) du[j] = gu[j + N*j];
+	if (do_d) for (int j = 0; j < N; j++) dd[j] = gd[j + N*j];
+	spin_barrier_wait(sb);
+	for (int ii = 0; ii < n_int;) {
+		// the k delayed vectors so far enter the next m sites with gemm.
+		// only the ones added within this block need gemv
+		const int m = (n_int - ii < n_inner) ? n_int - ii : n_inner;
+		const int k0 = k;
+		if (do_u) delayed_look_ahead(N, m, k0, int_sites, site_order + ii, gu, au, bu, xu, wu);
+		if (do_d) delayed_look_ahead(N, m, k0, int_sites, site_order + ii, gd, ad, bd, xd, wd);
+		for (int s = 0; s < m; s++) {
+			const int c = site_order[ii++];
+			const int i = int_sites[c];
+			const double delu = del[i + N*hs[c]];
+			const double deld = del[i + N*!hs[c]];
+			if (delu == 0.0 && deld == 0.0) continue;
+			const num ru = 1.0 + (1.0 - du[i]) * delu;
+			const num rd = 1.0 + (gd != NULL ? 1.0 - dd[i] : du[i]) * deld;
+			const num prob = ru * rd;
+			const double absprob = fabs(prob);
+			if (u[n_u++] < absprob) {
+				// everyone has decided on site i before du, dd and hs[c] change
+				spin_barrier_wait(sb);
+				if (tid == 0) {
+					hs[c] = !hs[c];
+					if (flip != NULL) flip[n_flip] = c;
+					*phase *= prob/absprob;
+				}
+				if (do_u) {
+					my_copy(au + N*k, xu + N*s, N);
+					my_copy(bu + N*k, xu + N*(m + s), N);
+					xgemv("N", N, k - k0, 1.0, au + N*k0, N, bu + i + N*k0,
+					      N, 1.0, au + N*k, 1);
+					xgemv("N", N, k - k0, 1.0, bu + N*k0, N, au + i + N*k0,
+					      N, 1.0, bu + N*k, 1);
+					au[i + N*k] -= 1.0;
+					for (int j = 0; j < N; j++) au[j + N*k] *= delu/ru;
+					for (int j = 0; j < N; j++) du[j] += au[j + N*k] * bu[j + N*k];
+				}
+				if (do_d) {
+					my_copy(ad + N*k, xd + N*s, N);
+					my_copy(bd + N*k, xd + N*(m + s), N);
+					xgemv("N", N, k - k0, 1.0, ad + N*k0, N, bd + i + N*k0,
+					      N, 1.0, ad + N*k, 1);
+					xgemv("N", N, k - k0, 1.0, bd + N*k0, N, ad + i + N*k0,
+					      N, 1.0, bd + N*k, 1);
+					ad[i + N*k] -= 1.0;
+					for (int j = 0; j < N; j++) ad[j + N*k] *= deld/rd;
+					for (int j = 0; j < N; j++) dd[j] += ad[j + N*k] * bd[j + N*k];
+				}
+				k++;
+				n_flip++;
+				const int full = (k == n_delay);
+				if (full) {
+					k = 0;
+					if (do_u) {
+						xgemm("N", "T", N, N, n_delay, 1.0,
+						      au, N, bu, N, 1.0, gu, N);
+						for (int j = 0; j < N; j++) du[j] = gu[j + N*j];
+					}
+					if (do_d) {
+						xgemm("N", "T", N, N, n_delay, 1.0,
+						      ad, N, bd, N, 1.0, gd, N);
+						for (int j = 0; j < N; j++) dd[j] = gd[j + N*j];
+					}
+				}
+				spin_barrier_wait(sb);
+				// look-ahead is stale
+				if (full) break;
+			}
+		}
 	}
+	if (do_u) xgemm("N", "T", N, N, k, 1.0, au, N, bu, N, 1.0, gu, N);
+	if (do_d) xgemm("N", "T", N, N, k, 1.0, ad, N, bd, N, 1.0, gd, N);
+	spin_barrier_wait(sb);
+	return n_flip;
 }
 
 /*
@@ -116,85 +241,124 @@ void update_shermor(const int N, const double *const restrict del,
 		}
 	}
 }
+*/
+
+// apply the k pending flips at sites r to g:
+// g <- g - g_r LU^-1 gr, then row r[j] of g scaled by DD[j]
+static void submat_flush(const int N, const int q, const int k,
+		const int *const restrict r, const num *const restrict DD,
+		const num *const restrict LU, num *const restrict gr,
+		const num *const restrict g_r, num *const restrict g)
+{
+	xtrtrs("L", "N", "U", k, N, LU, q, gr, q, &(int){0});
+	xtrtrs("U", "N", "N", k, N, LU, q, gr, q, &(int){0});
+	xgemm("N", "N", N, N, k, -1.0, g_r, N, gr, q, 1.0, g, N);
+	for (int j = 0; j < k; j++) {
+		const int rj = r[j];
+		const num DDj = DD[j];
+		for (int i = 0; i < N; i++)
+			g[rj + N*i] *= DDj;
+	}
+}
 
-void update_submat(const int N, const int q, const double *const restrict del,
+// the proposals need triangular solves on both spins. thread 0 makes all
+// decisions and fills the pending rows and columns; the other thread waits
+// at the spin barrier and joins each flush. r[k] < 0 marks the end of the
+// pending flips, -2 for the last flush
+int update_submat(const int N, const int q, const double *const restrict del,
+		const int n_int, const int *const restrict int_sites,
 		const int *const restrict site_order,
-		uint64_t *const restrict rng, int *const restrict hs,
-		double *const restrict gu, double *const restrict gd, int *const restrict sign,
-		double *const restrict gr_u, double *const restrict g_ru,
-		double *const restrict DDu, double *const restrict yu, double *const restrict xu,
-		double *const restrict gr_d, double *const restrict g_rd,
-		double *const restrict DDd, double *const restrict yd, double *const restrict xd)
+		const double *const restrict u, int *const restrict hs,
+		num *const restrict gu, num *const restrict gd, num *const restrict phase,
+		int *const restrict flip,
+		num *const restrict gr_u, num *const restrict g_ru,
+		num *const restrict DDu, num *const restrict yu, num *const restrict xu,
+		num *const restrict LUu,
+		num *const restrict gr_d, num *const restrict g_rd,
+		num *const restrict DDd, num *const restrict yd, num *const restrict xd,
+		num *const restrict LUd,
+		int *const restrict r,
+		struct spin_barrier *const sb)
 {
-	int *const restrict r = my_calloc(q * sizeof(int)); _aa(r);
-	double *const restrict LUu = my_calloc(q*q * sizeof(double)); _aa(LUu);
-	double *const restrict LUd = my_calloc(q*q * sizeof(double)); _aa(LUd);
+	SPIN_THREADS;
+	if (tid != 0) {
+		int n_flip = 0, done;
+		do {
+			spin_barrier_wait(sb);
+			int k = 0;
+			while (r[k] >= 0) k++;
+			done = (r[k] == -2);
+			n_flip += k;
+			if (do_d) submat_flush(N, q, k, r, DDd, LUd, gr_d, g_rd, gd);
+			spin_barrier_wait(sb);
+		} while (!done);
+		return n_flip;
+	}
 
-	int k = 0;
-	for (int ii = 0; ii < N; ii++) {
-		const int i = site_order[ii];
-		const double delu = del[i + N*hs[i]];
-		const double deld = del[i + N*!hs[i]];
-		double du = gu[i + N*i] - (1 + delu)/delu;
-		double dd = gd[i + N*i] - (1 + deld)/deld;
+	int k = 0, n_flip = 0, n_u = 0;
+	for (int ii = 0; ii <= n_int; ii++) {
+		const int last = (ii == n_int);
+		if (k == q || last) {
+			r[k] = last ? -2 : -1;
+			spin_barrier_wait(sb);
+			if (do_u) submat_flush(N, q, k, r, DDu, LUu, gr_u, g_ru, gu);
+			if (do_d) submat_flush(N, q, k, r, DDd, LUd, gr_d, g_rd, gd);
+			spin_barrier_wait(sb);
+			k = 0;
+		}
+		if (last) break;
+
+		const int c = site_order[ii];
+		const int i = int_sites[c];
+		const double delu = del[i + N*hs[c]];
+		const double deld = del[i + N*!hs[c]];
+		// same skip as update_delayed. del = exp_lambda^2 - 1 for both
+		// spins, so they vanish together (U = 0) and 1/del below is finite
+		if (delu == 0.0 && deld == 0.0) continue;
+		num du = gu[i + N*i] - (1.0 + delu)/delu;
+		num dd = (gd != NULL) ? gd[i + N*i] - (1.0 + deld)/deld : 0.0;
 		if (k > 0) {
-			for (int j = 0; j < k; j++) yu[j] = gr_u[j + N*i];
-			dtrtrs("L", "N", "U", &k, cint(1), LUu, &q, yu, &k, &(int){0});
+			for (int j = 0; j < k; j++) yu[j] = gr_u[j + q*i];
+			xtrtrs("L", "N", "U", k, 1, LUu, q, yu, k, &(int){0});
 			for (int j = 0; j < k; j++) xu[j] = g_ru[i + N*j];
-			dtrtrs("U", "T", "N", &k, cint(1), LUu, &q, xu, &k, &(int){0});
+			xtrtrs("U", "T", "N", k, 1, LUu, q, xu, k, &(int){0});
 			for (int j = 0; j < k; j++) du -= yu[j]*xu[j];
-
-			for (int j = 0; j < k; j++) yd[j] = gr_d[j + N*i];
-			dtrtrs("L", "N", "U", &k, cint(1), LUd, &q, yd, &k, &(int){0});
+		}
+		if (gd == NULL) // gd_ii = 1 - gu_ii, both with the pending flips
+			dd = 1.0 - du - (1.0 + delu)/delu - (1.0 + deld)/deld;
+		else if (k > 0) {
+			for (int j = 0; j < k; j++) yd[j] = gr_d[j + q*i];
+			xtrtrs("L", "N", "U", k, 1, LUd, q, yd, k, &(int){0});
 			for (int j = 0; j < k; j++) xd[j] = g_rd[i + N*j];
-			dtrtrs("U", "T", "N", &k, cint(1), LUd, &q, xd, &k, &(int){0});
+			xtrtrs("U", "T", "N", k, 1, LUd, q, xd, k, &(int){0});
 			for (int j = 0; j < k; j++) dd -= yd[j]*xd[j];
 		}
 
-		const double prob = du*delu * dd*deld;
-		if (rand_doub(rng) < fabs(prob)) {
+		// du*delu = -(1 + (1 - g_ii)*delu) with the pending flips
+		const num prob = du*delu * dd*deld;
+		const double absprob = fabs(prob);
+		if (u[n_u++] < absprob) {
 			r[k] = i;
-			DDu[k] = 1.0 / (1.0 + delu);
-			DDd[k] = 1.0 / (1.0 + deld);
-			for (int j = 0; j < N; j++) gr_u[k + N*j] = gu[i + N*j];
+			DDu[k] = 1.0/(1.0 + delu);
+			for (int j = 0; j < N; j++) gr_u[k + q*j] = gu[i + N*j];
 			for (int j = 0; j < N; j++) g_ru[j + N*k] = gu[j + N*i];
-			for (int j = 0; j < N; j++) gr_d[k + N*j] = gd[i + N*j];
-			for (int j = 0; j < N; j++) g_rd[j + N*k] = gd[j + N*i];
 			for (int j = 0; j < k; j++) LUu[j + q*k] = yu[j];
 			for (int j = 0; j < k; j++) LUu[k + q*j] = xu[j];
-			for (int j = 0; j < k; j++) LUd[j + q*k] = yd[j];
-			for (int j = 0; j < k; j++) LUd[k + q*j] = xd[j];
 			LUu[k + q*k] = du;
-			LUd[k + q*k] = dd;
-			k++;
-			hs[i] = !hs[i];
-			if (prob < 0) *sign *= -1;
-		}
-
-		if (k == q || (ii == N - 1 && k > 0)) {
-			dtrtrs("L", "N", "U", &k, &N, LUu, &q, gr_u, &N, &(int){0});
-			dtrtrs("U", "N", "N", &k, &N, LUu, &q, gr_u, &N, &(int){0});
-			dgemm("N", "N", &N, &N, &k, cdbl(-1.0), g_ru, &N, gr_u, &N, cdbl(1.0), gu, &N);
-			for (int j = 0; j < k; j++) {
-				const int rj = r[j];
-				const double DDk = DDu[j];
-				for (int iii = 0; iii < N; iii++)
-					gu[rj + iii*N] *= DDk;
-			}
-			dtrtrs("L", "N", "U", &k, &N, LUd, &q, gr_d, &N, &(int){0});
-			dtrtrs("U", "N", "N", &k, &N, LUd, &q, gr_d, &N, &(int){0});
-			dgemm("N", "N", &N, &N, &k, cdbl(-1.0), g_rd, &N, gr_d, &N, cdbl(1.0), gd, &N);
-			for (int j = 0; j < k; j++) {
-				const int rj = r[j];
-				const double DDk = DDd[j];
-				for (int iii = 0; iii < N; iii++)
-					gd[rj + iii*N] *= DDk;
+			if (gd != NULL) {
+				DDd[k] = 1.0/(1.0 + deld);
+				for (int j = 0; j < N; j++) gr_d[k + q*j] = gd[i + N*j];
+				for (int j = 0; j < N; j++) g_rd[j + N*k] = gd[j + N*i];
+				for (int j = 0; j < k; j++) LUd[j + q*k] = yd[j];
+				for (int j = 0; j < k; j++) LUd[k + q*j] = xd[j];
+				LUd[k + q*k] = dd;
 			}
-			k = 0;
+			k++;
+			hs[c] = !hs[c];
+			if (flip != NULL) flip[n_flip] = c;
+			n_flip++;
+			*phase *= prob/absprob;
 		}
 	}
-	my_free(LUd);
-	my_free(LUu);
-	my_free(r);
+	return n_flip;
 }
-*/
@@ -3,13 +3,54 @@
 #include <stdint.h>
 #include "util.h"
 
-void update_delayed(const int N, const int n_delay, const double *const restrict del,
+// update engine, set by /params/update_method
+enum {
+	UPDATE_AUTO = 0,    // submatrix for N >= SUBMAT_MIN_N, delayed otherwise
+	UPDATE_DELAYED = 1,
+	UPDATE_SUBMAT = 2,
+};
+#define SUBMAT_MIN_N 256
+
+// site_order is a permutation of 0 .. n_int-1, the positions in int_sites
+// of the interacting sites, and hs (size n_int) is indexed the same way.
+// returns the number of accepted flips. if flip != NULL, the positions of the
+// flipped sites are written to flip[0 .. n_flip-1] (size N). u holds the
+// uniforms for the proposals, one for each site in site_order with nonzero
+// del, in order
+//
+// the update functions may be called by both threads of a parallel region
+// (each thread must call with the same arguments), in which case thread 0
+// updates Gu and thread 1 Gd, meeting at the spin barrier sb, initialized
+// for the 2 threads. with sb->n = 1, the calling thread does both.
+// Gd == NULL means particle-hole symmetry (Gd = I - S Gu^T S): only Gu is
+// updated, and the spin down ratios use 1 - Gd_ii = Gu_ii
+int update_delayed(const int N, const int n_delay, const double *const restrict del,
+		const int n_int, const int *const restrict int_sites,
 		const int *const restrict site_order,
-		uint64_t *const restrict rng, int *const restrict hs,
+		const double *const restrict u, int *const restrict hs,
 		num *const restrict Gu, num *const restrict Gd, num *const restrict phase,
+		int *const restrict flip,
 		// work arrays (sizes: N*N, N*N, N)
 		num *const restrict au, num *const restrict bu, num *const restrict du,
-		num *const restrict ad, num *const restrict bd, num *const restrict dd);
+		num *const restrict ad, num *const restrict bd, num *const restrict dd,
+		struct spin_barrier *const sb);
+
+// two-level delayed updates: the delayed vectors are applied to the columns
+// and rows of the next n_inner sites in order with gemm, leaving gemv only
+// over the vectors added since. same results as update_delayed
+int update_delayed_rec(const int N, const int n_delay, const int n_inner,
+		const double *const restrict del,
+		const int n_int, const int *const restrict int_sites,
+		const int *const restrict site_order,
+		const double *const restrict u, int *const restrict hs,
+		num *const restrict Gu, num *const restrict Gd, num *const restrict phase,
+		int *const restrict flip,
+		// work arrays (sizes: N*N, N*N, N, 2*N*n_inner, n_inner*n_delay)
+		num *const restrict au, num *const restrict bu, num *const restrict du,
+		num *const restrict xu, num *const restrict wu,
+		num *const restrict ad, num *const restrict bd, num *const restrict dd,
+		num *const restrict xd, num *const restrict wd,
+		struct spin_barrier *const sb);
 
 /*
 // regular sherman morrison
@@ -20,15 +61,23 @@ void update_shermor(const int N, const double *const restrict del,
 		// work arrays (sizes: N, N)
 		double *const restrict cu, double *const restrict du,
 		double *const restrict cd, double *const restrict dd);
+*/
 
-// submatrix updates. generally worse performance except for very large N (>1000)
-void update_submat(const int N, const int q, const double *const restrict del,
+// submatrix updates: flips are collected in the q x q matrix Gamma (kept LU
+// factored) and applied to g with level 3 blas every q accepted flips.
+// same acceptance and return value as update_delayed
+int update_submat(const int N, const int q, const double *const restrict del,
+		const int n_int, const int *const restrict int_sites,
 		const int *const restrict site_order,
-		uint64_t *const restrict rng, int *const restrict hs,
-		double *const restrict Gu, double *const restrict Gd, int *const restrict sign,
-		// work arrays (sizes: N*N, N*N, N, N, N)
-		double *const restrict Gr_u, double *const restrict G_ru,
-		double *const restrict DDu, double *const restrict yu, double *const restrict xu,
-		double *const restrict Gr_d, double *const restrict G_rd,
-		double *const restrict DDd, double *const restrict yd, double *const restrict xd);
-*/
+		const double *const restrict u, int *const restrict hs,
+		num *const restrict Gu, num *const restrict Gd, num *const restrict phase,
+		int *const restrict flip,
+		// work arrays (sizes: q*N, N*q, q, q, q, q*q for each spin; q + 1)
+		num *const restrict Gr_u, num *const restrict G_ru,
+		num *const restrict DDu, num *const restrict yu, num *const restrict xu,
+		num *const restrict LUu,
+		num *const restrict Gr_d, num *const restrict G_rd,
+		num *const restrict DDd, num *const restrict yd, num *const restrict xd,
+		num *const restrict LUd,
+		int *const restrict r,
+		struct spin_barrier *const sb);
@@ -1,5 +1,7 @@
 #pragma once
 
+#include <sched.h>
+#include <stdatomic.h>
 #include <string.h>
 
 #ifdef USE_CPLX
@@ -21,3 +23,34 @@ static inline void *my_calloc(size_t size)
 	if (p != NULL) memset(p, 0, size);
 	return p;
 }
+
+// barrier for the n threads of a team that spins on a flag instead of
+// sleeping in the runtime, for the short waits between the spin up and spin
+// down threads. after SPIN_BARRIER_YIELD polls it yields, in case the
+// threads share a core
+#define SPIN_BARRIER_YIELD 4096
+
+struct spin_barrier {
+	int n;
+	atomic_int count, sense;
+};
+
+static inline void spin_barrier_init(struct spin_barrier *const b, const int n)
+{
+	b->n = n;
+	atomic_init(&b->count, 0);
+	atomic_init(&b->sense, 0);
+}
+
+static inline void spin_barrier_wait(struct spin_barrier *const b)
+{
+	if (b->n <= 1) return;
+	// sense can't flip before this thread arrives
+	const int sense = !atomic_load_explicit(&b->sense, memory_order_relaxed);
+	if (atomic_fetch_add_explicit(&b->count, 1, memory_order_acq_rel) == b->n - 1) {
+		atomic_store_explicit(&b->count, 0, memory_order_relaxed);
+		atomic_store_explicit(&b->sense, sense, memory_order_release);
+	} else
+		for (int k = 0; atomic_load_explicit(&b->sense, memory_order_acquire) != sense; k++)
+			if (k >= SPIN_BARRIER_YIELD) sched_yield();
+}
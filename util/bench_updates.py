@@ -0,0 +1,74 @@
+import os
+import re
+import shutil
+import subprocess
+import sys
+import tempfile
+
+import h5py
+
+import gen_1band_hub
+
+
+# time per call of the "updates" profile line, summed over threads
+def updates_time(log):
+    t = 0.0
+    for line in log.splitlines():
+        m = re.match(r"\s*updates \|.*\|\s*([\d.]+)\s*\|\s*\d+$", line)
+        if m:
+            t += float(m.group(1))
+    return t
+
+
+# compare single-level and two-level delayed updates (and submatrix updates)
+# on Nx x Nx lattices, using dqmc_1 in benchmark mode. n_delay is capped at N
+# and n_delay_inner at n_delay, as no more than N flips are pending per slice
+def bench(dqmc, sizes, n_delay, n_inner, n_sweep=10, L=8):
+    modes = [("delayed", False), ("delayed", True), ("submat", False)]
+    method = {"delayed": 1, "submat": 2}
+    print("{:>6} {:>8} ".format("N", "n_delay") + " ".join("{:>16}".format(
+        m if not inner else "{}/{}".format(m, n_inner)) for m, inner in modes) +
+        "   (us per call)")
+    with tempfile.TemporaryDirectory() as d:
+        for Nx in sizes:
+            N = Nx*Nx
+            nd = min(n_delay, N)
+            ni = min(n_inner, nd)
+            # the generator is slow for large N, so each lattice is made
+            # once and only the update parameters change between runs
+            base = os.path.join(d, "base.h5")
+            gen_1band_hub.create_1(filename=base, overwrite=True, seed=1,
+                                   Nx=Nx, Ny=Nx, L=L, n_matmul=L//2,
+                                   period_eqlt=L, n_delay=nd,
+                                   n_sweep_warm=n_sweep, n_sweep_meas=0)
+            row = []
+            for m, inner in modes:
+                path = os.path.join(d, "bench.h5")
+                shutil.copy(base, path)
+                with h5py.File(path, "r+") as f:
+                    f["params"]["update_method"][...] = method[m]
+                    f["params"]["n_delay_inner"][...] = ni if inner else 0
+                # dqmc_1 appends to the log
+                log = os.path.join(d, "bench.log")
+                if os.path.exists(log):
+                    os.remove(log)
+                subprocess.run([dqmc, "-b", "-l", log, path], check=True)
+                with open(log) as f:
+                    row.append(updates_time(f.read()))
+            print("{:>6} {:>8} ".format(N, nd) +
+                  " ".join("{:>16.1f}".format(t) for t in row))
+
+
+def main(argv):
+    if len(argv) < 2:
+        print("usage: {} path/to/dqmc_1 [n_delay=64] [n_delay_inner=8] "
+              "[Nx ...]".format(argv[0]))
+        return
+    n_delay = int(argv[2]) if len(argv) > 2 else 64
+    n_inner = int(argv[3]) if len(argv) > 3 else 8
+    sizes = [int(x) for x in argv[4:]] or [4, 6, 8, 12, 16]
+    bench(argv[1], sizes, n_delay, n_inner)
+
+
+if __name__ == "__main__":
+    main(sys.argv)
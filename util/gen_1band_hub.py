@@ -54,16 +54,123 @@ def rand_jump(rng):
         rng[(np.uint64(j) + rng[16]) & np.uint64(15)] = t[j]
 
 
+# philox4x32-10 state in the same 17 words (see rand.h): empty buffer,
+# counter 0. streams with different keys are independent
+RAND_PHILOX = 0x100
+
+
+def rand_seed_philox(key):
+    rng = np.zeros(17, dtype=np.uint64)
+    rng[8] = np.uint64(key & 0xFFFFFFFFFFFFFFFF)
+    rng[16] = RAND_PHILOX + 8
+    return rng
+
+
+def init_walkers(f, rng, n_walker, N, L, philox_key=None):
+    """states of walkers 1, ..., n_walker-1 of a multi-walker run, each
+    starting from the next jump of rng, or with philox_key, from the
+    philox streams philox_key + k. hs is kept on the interacting sites
+    /params/int_sites only"""
+    rng = rng.copy() if rng is not None else None
+    int_sites = f["params"]["int_sites"][...]
+    for k in range(1, n_walker):
+        if philox_key is not None:
+            w_rng = rand_seed_philox(philox_key + k)
+            gen = np.random.Generator(np.random.Philox(key=philox_key + k))
+            w_hs = gen.integers(0, 2, size=(L, N), dtype=np.int32)
+        else:
+            rand_jump(rng)
+            w_rng = rng.copy()
+            w_hs = np.zeros((L, N), dtype=np.int32)
+            for l in range(L):
+                for i in range(N):
+                    w_hs[l, i] = rand_uint(w_rng) >> np.uint64(63)
+        w_hs = np.ascontiguousarray(w_hs[:, int_sites])
+        g = f["state"].require_group("walker{}".format(k))
+        for name, val in (("sweep", np.array(0, dtype=np.int32)),
+                          ("rng", w_rng), ("hs", w_hs)):
+            if name in g:
+                g[name][...] = val
+            else:
+                g[name] = val
+
+
+def cb_groups(K):
+    """split the hopping bonds of K into groups with no shared sites
+    (greedy edge coloring)"""
+    groups = []
+    for i in range(K.shape[0]):
+        for j in range(i + 1, K.shape[0]):
+            if K[i, j] == 0:
+                continue
+            for sites, bonds in groups:
+                if i not in sites and j not in sites:
+                    break
+            else:
+                sites, bonds = set(), []
+                groups.append((sites, bonds))
+            sites.update((i, j))
+            bonds.append((i, j))
+    return [bonds for sites, bonds in groups]
+
+
+def cb_factors(K, groups, h):
+    """2x2 propagators exp(-h/2 K_b) for each bond, and exp(-h K_ii)"""
+    m = np.array([expm(-h/2 * np.array([[0, K[i, j]], [K[j, i], 0]]))
+                  for g in groups for i, j in g])
+    return m, np.exp(-h * np.diag(K).real)
+
+
+def cb_dense(groups, m, d):
+    """dense E_{G-1}...E_0 D E_0...E_{G-1}, same as cb_lmul() in cb.c"""
+    A = np.eye(d.size, dtype=m.dtype)
+    start = np.cumsum([0] + [len(g) for g in groups])
+    order = list(range(len(groups) - 1, -1, -1)) + [None] + list(range(len(groups)))
+    for g in order:
+        if g is None:
+            A = d[:, None] * A
+            continue
+        for b, (i, j) in enumerate(groups[g]):
+            A[[i, j], :] = m[start[g] + b] @ A[[i, j], :]
+    return A
+
+
 def create_1(filename=None, overwrite=False, seed=None,
              Nx=16, Ny=4, mu=0.0, tp=0.0, U=6.0, dt=0.115, L=40,
              nflux=0,
-             n_delay=16, n_matmul=8, n_sweep_warm=200, n_sweep_meas=2000,
+             n_delay=16, n_delay_inner=0, update_method="auto", n_matmul=8, udt_stack=0, stab="qrp", wrap_tol=0.0,
+             global_period=0, global_cluster=0, n_walker=1,
+             replica_period=0, replica_U=(), replica_mu=(), rng="xorshift",
+             checkerboard=0, fft_K=0, ph_sym=None,
+             n_sweep_warm=200, n_sweep_meas=2000,
              period_eqlt=8, period_uneqlt=0,
              meas_bond_corr=0, meas_3curr=0, meas_3curr_limit=0, meas_energy_corr=0, meas_nematic_corr=0,
-             trans_sym=1):
+             jjj_n_sample=0, c4v=0, meas_fft=0, trans_sym=1):
     assert L % n_matmul == 0 and L % period_eqlt == 0
+    # FFT exp_K needs a circulant K, and replaces the checkerboard
+    assert not fft_K or (trans_sym and nflux == 0 and not checkerboard)
+    # point group folding needs a square lattice without flux
+    assert not c4v or (trans_sym and Nx == Ny and nflux == 0)
+    # FFT 2 site measurements index num_ij by the displacement itself
+    assert not meas_fft or (trans_sym and nflux == 0)
     N = Nx * Ny
 
+    # replica exchange: replica k >= 1 runs at replica_U[k-1] and
+    # replica_mu[k-1] (U and mu if not given), one walker per replica.
+    # lists can also be passed as comma separated strings
+    if isinstance(replica_U, str):
+        replica_U = [float(x) for x in replica_U.split(",")]
+    if isinstance(replica_mu, str):
+        replica_mu = [float(x) for x in replica_mu.split(",")]
+    replica_U, replica_mu = np.atleast_1d(replica_U), np.atleast_1d(replica_mu)
+    n_replica = 1 + max(len(replica_U), len(replica_mu))
+    replicas = [(replica_U[k] if k < len(replica_U) else U,
+                 replica_mu[k] if k < len(replica_mu) else mu)
+                for k in range(n_replica - 1)]
+    if n_replica > 1:
+        assert not checkerboard and n_walker in (1, n_replica)
+        n_walker = n_replica
+
     if nflux != 0:
         dtype_num = np.complex
     else:
@@ -211,6 +318,62 @@ def create_1(filename=None, overwrite=False, seed=None,
                                         else:
                                             map_bbb_lim[j + N*jj, i1 + N*ii1, i2 + N*ii2] = -1
                                 
+    # C4v folding of the 2 and 3 bond mappings: of each orbit of translation
+    # classes under the point group, only the first class is measured and the
+    # others are -1 in map_bb, map_bbb. orbit_bb[k] is the folded class of
+    # translation class k, and orbit_bb_sign[k] the product of the bond
+    # reversals taking the measured class to k: currents (jj, jsjs, jjj)
+    # change sign with it, the other bond correlators don't
+    if c4v:
+        ops = ((1, 0, 0, 1), (0, -1, 1, 0), (-1, 0, 0, -1), (0, 1, -1, 0),
+               (1, 0, 0, -1), (-1, 0, 0, 1), (0, 1, 1, 0), (0, -1, -1, 0))
+        bond_of = {(bonds[0, b], bonds[1, b]): b for b in range(num_b)}
+        bimg = np.zeros((len(ops), num_b), dtype=np.int32)
+        bsign = np.ones((len(ops), num_b), dtype=np.int32)
+        for g, (a, b, c, d) in enumerate(ops):
+            def site(i):
+                x, y = i % Nx, i // Nx
+                return (a*x + b*y) % Nx + Nx*((c*x + d*y) % Ny)
+            for ib in range(num_b):
+                s0, s1 = site(bonds[0, ib]), site(bonds[1, ib])
+                if (s0, s1) in bond_of:
+                    bimg[g, ib] = bond_of[(s0, s1)]
+                else:
+                    bimg[g, ib] = bond_of[(s1, s0)]
+                    bsign[g, ib] = -1
+
+        # rep[k]: bonds of one member of translation class k
+        def fold(mapping, rep):
+            orbit = -np.ones(len(rep), dtype=np.int32)
+            sign = np.ones(len(rep), dtype=np.int32)
+            first = np.zeros(len(rep), dtype=bool)
+            n = 0
+            for k in range(len(rep)):
+                if orbit[k] >= 0:
+                    continue
+                first[k] = True
+                for g in range(len(ops)):
+                    kk = mapping[tuple(bimg[g, rep[k]])]
+                    if orbit[kk] < 0:
+                        orbit[kk] = n
+                        sign[kk] = np.prod(bsign[g, rep[k]])
+                n += 1
+            return orbit, sign, first
+
+        rep_bb = [(N*(kk // (num_ij*bps)), kk % num_ij + N*((kk // num_ij) % bps))
+                  for kk in range(num_bb)]
+        orbit_bb, orbit_bb_sign, first = fold(map_bb, rep_bb)
+        map_bb = np.where(first[map_bb], orbit_bb[map_bb], -1).astype(np.int32)
+        degen_bb = degen_bb[first]
+        num_bb = degen_bb.size
+
+        rep_bbb = [(N*(dd // (N*N*bps*bps)), (dd // N) % N + N*((dd // (N*N*bps)) % bps),
+                    dd % N + N*((dd // (N*N)) % bps)) for dd in range(num_bbb)]
+        orbit_bbb, orbit_bbb_sign, first = fold(map_bbb, rep_bbb)
+        map_bbb = np.where(first[map_bbb], orbit_bbb[map_bbb], -1).astype(np.int32)
+        degen_bbb = degen_bbb[first]
+        num_bbb = degen_bbb.size
+
     # intergral kernel  --to implement (Cubic spline fit+integral) with discrete imaginary time
     integral_kernel = np.array([0],dtype=np.float64)
     kernel = CubicSpline(np.arange(L+1), np.identity(L+1)).integrate(0, L)
@@ -274,14 +437,33 @@ def create_1(filename=None, overwrite=False, seed=None,
         Ku[i, i] -= mu
         Kd[i, i] -= mu
 
-    exp_Ku = expm(-dt * Ku)
-    exp_Kd = expm(-dt * Kd)
-    inv_exp_Ku = expm(dt * Ku)
-    inv_exp_Kd = expm(dt * Kd)
-    exp_halfKu = expm(-dt/2 * Ku)
-    exp_halfKd = expm(-dt/2 * Kd)
-    inv_exp_halfKu = expm(dt/2 * Ku)
-    inv_exp_halfKd = expm(dt/2 * Kd)
+    if checkerboard:
+        # the dense matrices are the checkerboard products, so that dense
+        # and sparse multiplication agree. the C code reads matrices
+        # column-major, so the factors are built from K.T and the dense
+        # products transposed back
+        cKu, cKd = Ku.T, Kd.T
+        cb_g = cb_groups(cKu)
+        assert cb_groups(cKd) == cb_g
+        cb_mu, cb_du = zip(cb_factors(cKu, cb_g, dt), cb_factors(cKu, cb_g, -dt))
+        cb_md, cb_dd = zip(cb_factors(cKd, cb_g, dt), cb_factors(cKd, cb_g, -dt))
+        exp_Ku = cb_dense(cb_g, cb_mu[0], cb_du[0]).T
+        exp_Kd = cb_dense(cb_g, cb_md[0], cb_dd[0]).T
+        inv_exp_Ku = cb_dense(cb_g, cb_mu[1], cb_du[1]).T
+        inv_exp_Kd = cb_dense(cb_g, cb_md[1], cb_dd[1]).T
+        exp_halfKu = cb_dense(cb_g, *cb_factors(cKu, cb_g, dt/2)).T
+        exp_halfKd = cb_dense(cb_g, *cb_factors(cKd, cb_g, dt/2)).T
+        inv_exp_halfKu = cb_dense(cb_g, *cb_factors(cKu, cb_g, -dt/2)).T
+        inv_exp_halfKd = cb_dense(cb_g, *cb_factors(cKd, cb_g, -dt/2)).T
+    else:
+        exp_Ku = expm(-dt * Ku)
+        exp_Kd = expm(-dt * Kd)
+        inv_exp_Ku = expm(dt * Ku)
+        inv_exp_Kd = expm(dt * Kd)
+        exp_halfKu = expm(-dt/2 * Ku)
+        exp_halfKd = expm(-dt/2 * Kd)
+        inv_exp_halfKu = expm(dt/2 * Ku)
+        inv_exp_halfKd = expm(dt/2 * Kd)
 #   exp_K = np.array(mpm.expm(mpm.matrix(-dt * K)).tolist(), dtype=np.float64)
 
     U_i = U*np.ones_like(degen_i, dtype=np.float64)
@@ -293,6 +475,25 @@ def create_1(filename=None, overwrite=False, seed=None,
     exp_lambda = np.array((1.0/exp_lmbd[map_i], exp_lmbd[map_i]))
     delll = np.array((exp_lmbd[map_i]**2 - 1, exp_lmbd[map_i]**-2 - 1))
 
+    # particle-hole symmetry: Kd = -S Ku^T S with S = (-1)^(x+y), which
+    # needs a bipartite lattice (even Nx, Ny, no t'), mu = 0 in every
+    # replica and no flux. ph_sym=None detects it, 0 turns it off
+    ph_sign = np.array([(-1.0)**(ix + iy) for iy in range(Ny)
+                        for ix in range(Nx)])
+    ph_ok = dtype_num == np.float64 and \
+        all(mu_k == 0.0 for _, mu_k in [(U, mu)] + replicas) and \
+        np.allclose(Kd, -ph_sign[:, None]*Ku.T*ph_sign[None, :], atol=1e-12)
+    if ph_sym is None:
+        ph_sym = int(ph_ok)
+    assert not ph_sym or ph_ok
+
+    # HS fields only on sites with U != 0 (in any replica). the initial
+    # fields are drawn for all sites, so that files with every site
+    # interacting are unchanged
+    interacting = (delll != 0).any(axis=0) | any(U_k != 0 for U_k, _ in replicas)
+    int_sites = np.flatnonzero(interacting).astype(np.int32)
+    init_hs = np.ascontiguousarray(init_hs[:, int_sites])
+
     if filename is None:
         filename = "{}.h5".format(seed)
     with h5py.File(filename, "w" if overwrite else "x") as f:
@@ -309,6 +510,12 @@ def create_1(filename=None, overwrite=False, seed=None,
         f["metadata"]["nflux"] = nflux
         f["metadata"]["mu"] = mu
         f["metadata"]["beta"] = L*dt
+        f["metadata"]["c4v"] = c4v
+        if c4v:
+            f["metadata"]["orbit_bb"] = orbit_bb
+            f["metadata"]["orbit_bb_sign"] = orbit_bb_sign
+            f["metadata"]["orbit_bbb"] = orbit_bbb
+            f["metadata"]["orbit_bbb_sign"] = orbit_bbb_sign
 
         # parameters used by dqmc code
         f.create_group("params")
@@ -333,6 +540,16 @@ def create_1(filename=None, overwrite=False, seed=None,
         # simulation parameters
         f["params"]["n_matmul"] = np.array(n_matmul, dtype=np.int32)
         f["params"]["n_delay"] = np.array(n_delay, dtype=np.int32)
+        f["params"]["n_delay_inner"] = np.array(n_delay_inner, dtype=np.int32)
+        f["params"]["update_method"] = np.array({"auto": 0, "delayed": 1, "submat": 2}[update_method], dtype=np.int32)
+        f["params"]["udt_stack"] = np.array(udt_stack, dtype=np.int32)
+        f["params"]["stab"] = np.array({"qrp": 0, "qr": 1, "svd": 2, "ldr": 3}[stab], dtype=np.int32)
+        f["params"]["wrap_tol"] = np.array(wrap_tol, dtype=np.float64)
+        f["params"]["global_period"] = np.array(global_period, dtype=np.int32)
+        f["params"]["global_cluster"] = np.array(global_cluster, dtype=np.int32)
+        f["params"]["n_walker"] = np.array(n_walker, dtype=np.int32)
+        f["params"]["replica_period"] = np.array(replica_period if n_replica > 1 else 0,
+                                                 dtype=np.int32)
         f["params"]["n_sweep_warm"] = np.array(n_sweep_warm, dtype=np.int32)
         f["params"]["n_sweep_meas"] = np.array(n_sweep_meas, dtype=np.int32)
         f["params"]["period_eqlt"] = np.array(period_eqlt, dtype=np.int32)
@@ -340,6 +557,8 @@ def create_1(filename=None, overwrite=False, seed=None,
         f["params"]["meas_bond_corr"] = meas_bond_corr
         f["params"]["meas_3curr"] = meas_3curr
         f["params"]["meas_3curr_limit"] = meas_3curr_limit
+        # > 0: jjj from this many random bond triples per measurement
+        f["params"]["jjj_n_sample"] = np.array(jjj_n_sample, dtype=np.int32)
         f["params"]["meas_energy_corr"] = meas_energy_corr
         f["params"]["meas_nematic_corr"] = meas_nematic_corr
         f["params"]["init_rng"] = init_rng  # save if need to replicate data
@@ -369,60 +588,123 @@ def create_1(filename=None, overwrite=False, seed=None,
         f["params"]["exp_lambda"] = exp_lambda
         f["params"]["del"] = delll
         f["params"]["F"] = np.array(L//n_matmul, dtype=np.int32)
+        f["params"]["n_int"] = np.array(len(int_sites), dtype=np.int32)
+        f["params"]["int_sites"] = int_sites
+        f["params"]["checkerboard"] = np.array(checkerboard, dtype=np.int32)
+        if checkerboard:
+            f["params"]["cb_n_group"] = np.array(len(cb_g), dtype=np.int32)
+            f["params"]["cb_n_bond"] = np.array(sum(map(len, cb_g)), dtype=np.int32)
+            f["params"]["cb_group"] = np.cumsum([0] + [len(g) for g in cb_g]).astype(np.int32)
+            f["params"]["cb_bonds"] = np.array([b for g in cb_g for b in g], dtype=np.int32).T.copy()
+            f["params"]["cb_mu"] = np.array(cb_mu, dtype=dtype_num)
+            f["params"]["cb_md"] = np.array(cb_md, dtype=dtype_num)
+            f["params"]["cb_du"] = np.array(cb_du)
+            f["params"]["cb_dd"] = np.array(cb_dd)
+        f["params"]["ph_sym"] = np.array(ph_sym, dtype=np.int32)
+        if ph_sym:
+            f["params"]["ph_sign"] = ph_sign
+        f["params"]["fft_K"] = np.array(fft_K, dtype=np.int32)
+        f["params"]["meas_fft"] = np.array(meas_fft, dtype=np.int32)
+        if fft_K or meas_fft:
+            f["params"]["Nx"] = np.array(Nx, dtype=np.int32)
+            f["params"]["Ny"] = np.array(Ny, dtype=np.int32)
         f["params"]["n_sweep"] = np.array(n_sweep_warm + n_sweep_meas,
                                           dtype=np.int32)
 
         # simulation state
         f.create_group("state")
         f["state"]["sweep"] = np.array(0, dtype=np.int32)
-        f["state"]["rng"] = init_rng
         f["state"]["hs"] = init_hs
+        if rng == "philox":
+            philox_key = int(rand_seed(seed)[0])
+            f["state"]["rng"] = rand_seed_philox(philox_key)
+            init_walkers(f, None, n_walker, N, L, philox_key)
+        else:
+            f["state"]["rng"] = init_rng
+            init_walkers(f, rand_seed(seed), n_walker, N, L)
 
         # measurements
-        f.create_group("meas_eqlt")
-        f["meas_eqlt"]["n_sample"] = np.array(0, dtype=np.int32)
-        f["meas_eqlt"]["sign"] = np.array(0.0, dtype=dtype_num)
-        f["meas_eqlt"]["density"] = np.zeros(num_i, dtype=dtype_num)
-        f["meas_eqlt"]["double_occ"] = np.zeros(num_i, dtype=dtype_num)
-        f["meas_eqlt"]["g00"] = np.zeros(num_ij, dtype=dtype_num)
-        f["meas_eqlt"]["nn"] = np.zeros(num_ij, dtype=dtype_num)
-        f["meas_eqlt"]["xx"] = np.zeros(num_ij, dtype=dtype_num)
-        f["meas_eqlt"]["zz"] = np.zeros(num_ij, dtype=dtype_num)
-        f["meas_eqlt"]["pair_sw"] = np.zeros(num_ij, dtype=dtype_num)
-        if meas_energy_corr:
-            f["meas_eqlt"]["kk"] = np.zeros(num_bb, dtype=dtype_num)
-            f["meas_eqlt"]["kv"] = np.zeros(num_bs, dtype=dtype_num)
-            f["meas_eqlt"]["kn"] = np.zeros(num_bs, dtype=dtype_num)
-            f["meas_eqlt"]["vv"] = np.zeros(num_ij, dtype=dtype_num)
-            f["meas_eqlt"]["vn"] = np.zeros(num_ij, dtype=dtype_num)
-
-        if period_uneqlt > 0:
-            f.create_group("meas_uneqlt")
-            f["meas_uneqlt"]["n_sample"] = np.array(0, dtype=np.int32)
-            f["meas_uneqlt"]["sign"] = np.array(0.0, dtype=dtype_num)
-            f["meas_uneqlt"]["gt0"] = np.zeros(num_ij*L, dtype=dtype_num)
-            f["meas_uneqlt"]["nn"] = np.zeros(num_ij*L, dtype=dtype_num)
-            f["meas_uneqlt"]["xx"] = np.zeros(num_ij*L, dtype=dtype_num)
-            f["meas_uneqlt"]["zz"] = np.zeros(num_ij*L, dtype=dtype_num)
-            f["meas_uneqlt"]["pair_sw"] = np.zeros(num_ij*L, dtype=dtype_num)
-            if meas_bond_corr:
-                f["meas_uneqlt"]["pair_bb"] = np.zeros(num_bb*L, dtype=dtype_num)
-                f["meas_uneqlt"]["jj"] = np.zeros(num_bb*L, dtype=dtype_num)
-                f["meas_uneqlt"]["jsjs"] = np.zeros(num_bb*L, dtype=dtype_num)
-                f["meas_uneqlt"]["kk"] = np.zeros(num_bb*L, dtype=dtype_num)
-                f["meas_uneqlt"]["ksks"] = np.zeros(num_bb*L, dtype=dtype_num)
+        def meas_groups(g):
+            g.create_group("meas_eqlt")
+            g["meas_eqlt"]["n_sample"] = np.array(0, dtype=np.int32)
+            g["meas_eqlt"]["sign"] = np.array(0.0, dtype=dtype_num)
+            g["meas_eqlt"]["density"] = np.zeros(num_i, dtype=dtype_num)
+            g["meas_eqlt"]["double_occ"] = np.zeros(num_i, dtype=dtype_num)
+            g["meas_eqlt"]["g00"] = np.zeros(num_ij, dtype=dtype_num)
+            g["meas_eqlt"]["nn"] = np.zeros(num_ij, dtype=dtype_num)
+            g["meas_eqlt"]["xx"] = np.zeros(num_ij, dtype=dtype_num)
+            g["meas_eqlt"]["zz"] = np.zeros(num_ij, dtype=dtype_num)
+            g["meas_eqlt"]["pair_sw"] = np.zeros(num_ij, dtype=dtype_num)
+            if meas_fft:
+                # structure factors S(q) of the above, q = kx + Nx*ky
+                for name in ("g00", "nn", "xx", "zz", "pair_sw"):
+                    g["meas_eqlt"][name + "_q"] = np.zeros(num_ij, dtype=dtype_num)
             if meas_energy_corr:
-                f["meas_uneqlt"]["kv"] = np.zeros(num_bs*L, dtype=dtype_num)
-                f["meas_uneqlt"]["kn"] = np.zeros(num_bs*L, dtype=dtype_num)
-                f["meas_uneqlt"]["vv"] = np.zeros(num_ij*L, dtype=dtype_num)
-                f["meas_uneqlt"]["vn"] = np.zeros(num_ij*L, dtype=dtype_num)
-            if meas_nematic_corr:
-                f["meas_uneqlt"]["nem_nnnn"] = np.zeros(num_bb*L, dtype=dtype_num)
-                f["meas_uneqlt"]["nem_ssss"] = np.zeros(num_bb*L, dtype=dtype_num)
-            if meas_3curr:
-                 f["meas_uneqlt"]["jjj"] = np.zeros(num_bbb*L, dtype=np.float64)
-            if meas_3curr_limit:
-                 f["meas_uneqlt"]["jjj_l"] = np.zeros(num_bbb_lim*L, dtype=np.float64)
+                g["meas_eqlt"]["kk"] = np.zeros(num_bb, dtype=dtype_num)
+                g["meas_eqlt"]["kv"] = np.zeros(num_bs, dtype=dtype_num)
+                g["meas_eqlt"]["kn"] = np.zeros(num_bs, dtype=dtype_num)
+                g["meas_eqlt"]["vv"] = np.zeros(num_ij, dtype=dtype_num)
+                g["meas_eqlt"]["vn"] = np.zeros(num_ij, dtype=dtype_num)
+
+            if period_uneqlt > 0:
+                g.create_group("meas_uneqlt")
+                g["meas_uneqlt"]["n_sample"] = np.array(0, dtype=np.int32)
+                g["meas_uneqlt"]["sign"] = np.array(0.0, dtype=dtype_num)
+                g["meas_uneqlt"]["gt0"] = np.zeros(num_ij*L, dtype=dtype_num)
+                g["meas_uneqlt"]["nn"] = np.zeros(num_ij*L, dtype=dtype_num)
+                g["meas_uneqlt"]["xx"] = np.zeros(num_ij*L, dtype=dtype_num)
+                g["meas_uneqlt"]["zz"] = np.zeros(num_ij*L, dtype=dtype_num)
+                g["meas_uneqlt"]["pair_sw"] = np.zeros(num_ij*L, dtype=dtype_num)
+                if meas_fft:
+                    for name in ("gt0", "nn", "xx", "zz", "pair_sw"):
+                        g["meas_uneqlt"][name + "_q"] = np.zeros(num_ij*L, dtype=dtype_num)
+                if meas_bond_corr:
+                    g["meas_uneqlt"]["pair_bb"] = np.zeros(num_bb*L, dtype=dtype_num)
+                    g["meas_uneqlt"]["jj"] = np.zeros(num_bb*L, dtype=dtype_num)
+                    g["meas_uneqlt"]["jsjs"] = np.zeros(num_bb*L, dtype=dtype_num)
+                    g["meas_uneqlt"]["kk"] = np.zeros(num_bb*L, dtype=dtype_num)
+                    g["meas_uneqlt"]["ksks"] = np.zeros(num_bb*L, dtype=dtype_num)
+                if meas_energy_corr:
+                    g["meas_uneqlt"]["kv"] = np.zeros(num_bs*L, dtype=dtype_num)
+                    g["meas_uneqlt"]["kn"] = np.zeros(num_bs*L, dtype=dtype_num)
+                    g["meas_uneqlt"]["vv"] = np.zeros(num_ij*L, dtype=dtype_num)
+                    g["meas_uneqlt"]["vn"] = np.zeros(num_ij*L, dtype=dtype_num)
+                if meas_nematic_corr:
+                    g["meas_uneqlt"]["nem_nnnn"] = np.zeros(num_bb*L, dtype=dtype_num)
+                    g["meas_uneqlt"]["nem_ssss"] = np.zeros(num_bb*L, dtype=dtype_num)
+                if meas_3curr:
+                     g["meas_uneqlt"]["jjj"] = np.zeros(num_bbb*L, dtype=np.float64)
+                if meas_3curr and jjj_n_sample > 0:
+                    g["meas_uneqlt"]["jjj_n"] = np.zeros(num_bbb, dtype=np.int32)
+                if meas_3curr_limit:
+                     g["meas_uneqlt"]["jjj_l"] = np.zeros(num_bbb_lim*L, dtype=np.float64)
+
+        meas_groups(f)
+
+        # replicas 1, 2, ...: parameters that differ from replica 0, and
+        # their own measurements
+        for k, (U_k, mu_k) in enumerate(replicas, 1):
+            g = f.create_group("replica{}".format(k))
+            g.create_group("metadata")
+            g["metadata"]["U"] = U_k
+            g["metadata"]["mu"] = mu_k
+            g.create_group("params")
+            Ku_k = Ku + (mu - mu_k)*np.eye(N)
+            Kd_k = Kd + (mu - mu_k)*np.eye(N)
+            g["params"]["exp_Ku"] = expm(-dt * Ku_k)
+            g["params"]["exp_Kd"] = expm(-dt * Kd_k)
+            g["params"]["inv_exp_Ku"] = expm(dt * Ku_k)
+            g["params"]["inv_exp_Kd"] = expm(dt * Kd_k)
+            g["params"]["exp_halfKu"] = expm(-dt/2 * Ku_k)
+            g["params"]["exp_halfKd"] = expm(-dt/2 * Kd_k)
+            g["params"]["inv_exp_halfKu"] = expm(dt/2 * Ku_k)
+            g["params"]["inv_exp_halfKd"] = expm(dt/2 * Kd_k)
+            exp_lmbd_k = np.exp(0.5*U_k*dt) + np.sqrt(np.expm1(U_k*dt))
+            g["params"]["exp_lambda"] = np.array((1.0/exp_lmbd_k*np.ones(N),
+                                                  exp_lmbd_k*np.ones(N)))
+            g["params"]["del"] = np.array((exp_lmbd_k**2 - 1 + np.zeros(N),
+                                           exp_lmbd_k**-2 - 1 + np.zeros(N)))
+            meas_groups(g)
     return filename
 
 
@@ -439,22 +721,35 @@ def create_batch(Nfiles=1, prefix=None, seed=None, **kwargs):
     with h5py.File(file_0, "r") as f:
         N = f["params"]["N"][...]
         L = f["params"]["L"][...]
+        n_walker = f["params"]["n_walker"][...]
+        int_sites = f["params"]["int_sites"][...]
+        philox_key = int(f["state"]["rng"][8]) \
+            if f["state"]["rng"][16] >= RAND_PHILOX else None
 
+    # each file takes n_walker jumps of rng, one for each walker
     for i in range(1, Nfiles):
-        rand_jump(rng)
+        for k in range(n_walker):
+            rand_jump(rng)
         init_rng = rng.copy()
         init_hs = np.zeros((L, N), dtype=np.int32)
 
         for l in range(L):
             for r in range(N):
                 init_hs[l, r] = rand_uint(init_rng) >> np.uint64(63)
+        init_hs = np.ascontiguousarray(init_hs[:, int_sites])
 
         file_i = "{}_{}.h5".format(prefix, i)
         shutil.copy2(file_0, file_i)
         with h5py.File(file_i, "r+") as f:
             f["params"]["init_rng"][...] = init_rng
-            f["state"]["rng"][...] = init_rng
             f["state"]["hs"][...] = init_hs
+            if philox_key is not None:
+                key_i = philox_key + i*int(n_walker)
+                f["state"]["rng"][...] = rand_seed_philox(key_i)
+                init_walkers(f, None, n_walker, N, L, key_i)
+            else:
+                f["state"]["rng"][...] = init_rng
+                init_walkers(f, rng, n_walker, N, L)
     return file_0 if Nfiles == 1 else "{} ... {}".format(file_0, file_i)
 
 